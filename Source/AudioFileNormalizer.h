@@ -6,52 +6,31 @@
 class AudioFileNormalizer : public AudioFileProcessor
 {
 public:
-    AudioFileNormalizer(File file) :
-        AudioFileProcessor(file, " - normalising") { }
+    AudioFileNormalizer(File file, SharedResources *resources = nullptr) :
+        AudioFileProcessor(file, " - normalising", resources) { }
 protected :
-    void processInternal() override
+    bool processInternal() override
     {
-        newSource->prepareToPlay(bufferSize, reader->sampleRate);
-        newSource->setLooping(false);
+        const int64 length = reader->lengthInSamples;
+
         // first read once the file to get max amplitude sample
         float max = 0;
-        int samplesTreated = 0;
-        do
+        for (int64 start = 0; start < length; start += bufferSize)
         {
-            channelInfo.numSamples = (samplesTreated + bufferSize) > (int)newSource->getTotalLength() ?
-                (int)newSource->getTotalLength() - samplesTreated :
-                bufferSize;
-
-            newSource->getNextAudioBlock(channelInfo);
+            const int numSamples = (int)jmin((int64)bufferSize, length - start);
+            if (!readBlock(start, numSamples))
+            {
+                return false;
+            }
             // get the magnitude of the buffer and compare to the max we have
-            max = jmax(channelInfo.buffer->getMagnitude(0, channelInfo.numSamples), max);
-            samplesTreated += channelInfo.numSamples;
-        } while (samplesTreated < newSource->getTotalLength());
+            max = jmax(buffer.getMagnitude(0, numSamples), max);
+        }
 
         // determine normalization factor
         float factor = 0.99f / max;
-        
-        // reset play head
-        newSource->setNextReadPosition(0);
-        samplesTreated = 0;
 
         /// now reread the file, apply gain on the temp buffer and write it to the temp file
-        do
-        {
-            channelInfo.numSamples = (samplesTreated + bufferSize) > (int)newSource->getTotalLength() ?
-                (int)newSource->getTotalLength() - samplesTreated :
-                bufferSize;
-            newSource->getNextAudioBlock(channelInfo);
-            channelInfo.buffer->applyGain(0, channelInfo.numSamples, factor);
-            if (writer->writeFromAudioSampleBuffer(*channelInfo.buffer, channelInfo.startSample, channelInfo.numSamples)) {
-                samplesTreated += channelInfo.numSamples;
-                writer->flush();
-            }
-            else { // should never happen
-                jassertfalse;
-                break;
-            }
-        } while (samplesTreated < newSource->getTotalLength());
+        return copyRange(0, length, factor);
     }
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioFileNormalizer)
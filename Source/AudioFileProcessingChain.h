@@ -0,0 +1,125 @@
+#pragma once
+
+#include <limits>
+#include <JuceHeader.h>
+#include "AudioFileProcessor.h"
+
+// The treatment of a tune as a chain of stages (gain, dither...) applied to a window of the file, the
+// trim, in a single pass: one decode, one temp file and one encode, however many stages there are.
+// The stages run in the order they were added, each on the whole block, on the processing thread of
+// the pass (see BlockPipeline).
+class AudioFileProcessingChain : public AudioFileProcessor
+{
+public:
+    class Stage
+    {
+    public:
+        virtual ~Stage() = default;
+
+        // before the pass: the length of the output, which starts at the window
+        virtual void prepare(double sampleRate, int64 numSamples)
+        {
+            ignoreUnused(sampleRate, numSamples);
+        }
+
+        // position is where the block starts in the output
+        virtual void process(AudioSampleBuffer &block, int numSamples, int64 position) = 0;
+    };
+
+    AudioFileProcessingChain(File file, SharedResources *resources = nullptr) :
+        AudioFileProcessor(file, " - processing", resources)
+    { }
+
+    // the samples to keep, the whole file by default
+    void setWindow(int64 newStartSample, int64 newNumSamples)
+    {
+        startSample = newStartSample;
+        numSamples = newNumSamples;
+    }
+
+    // takes the ownership of the stage
+    void addStage(Stage *stage)
+    {
+        stages.add(stage);
+    }
+
+    // the bit depth of the copy, for a dither
+    int getBitsPerSample() const
+    {
+        return writer != nullptr ? writer->getBitsPerSample() : 0;
+    }
+
+protected:
+    bool processInternal() override
+    {
+        const int64 length = jmin(numSamples, reader->lengthInSamples - startSample);
+        for (auto *stage : stages)
+        {
+            stage->prepare(reader->sampleRate, length);
+        }
+
+        BlockProcess process;
+        if (stages.size() > 0)
+        {
+            process = [this](AudioSampleBuffer &block, int blockLength, int64 position) {
+                for (auto *stage : stages)
+                    stage->process(block, blockLength, position);
+            };
+        }
+        return copyRange(startSample, length, process);
+    }
+
+private:
+    int64 startSample = 0;
+    int64 numSamples = std::numeric_limits<int64>::max();
+    OwnedArray<Stage> stages;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioFileProcessingChain)
+};
+
+class GainStage : public AudioFileProcessingChain::Stage
+{
+public:
+    GainStage(float gain)
+        : gain(gain)
+    {
+    }
+
+    void process(AudioSampleBuffer &block, int numSamples, int64) override
+    {
+        block.applyGain(0, numSamples, gain);
+    }
+
+private:
+    const float gain;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(GainStage)
+};
+
+// TPDF dither of one LSB of the output bit depth, so that a gain doesn't leave its rounding error as distortion
+class DitherStage : public AudioFileProcessingChain::Stage
+{
+public:
+    DitherStage(int bitsPerSample)
+        : lsb(1.0f / (float)(1 << (bitsPerSample - 1)))
+    {
+    }
+
+    void process(AudioSampleBuffer &block, int numSamples, int64) override
+    {
+        for (int channel = 0; channel < block.getNumChannels(); channel++)
+        {
+            float *samples = block.getWritePointer(channel);
+            for (int i = 0; i < numSamples; i++)
+            {
+                samples[i] += (random.nextFloat() - random.nextFloat()) * lsb;
+            }
+        }
+    }
+
+private:
+    const float lsb;
+    Random random;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(DitherStage)
+};
\ No newline at end of file
@@ -1,71 +1,212 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "BlockPipeline.h"
+#include "ParallelFlacWriter.h"
 
+// Rewrites a file into a temp copy, then replaces it. The file is read straight into a buffer with the
+// channels of the file, by blocks of about blockBytes (the same for the output stream), and the writer
+// is only flushed when it is closed: the pass is a few large sequential reads and writes. WAV (and AIFF)
+// files are read from a memory map, without a read call or a copy through a stream buffer.
+//
+// copyRange() runs its reads, its DSP and its writes as a BlockPipeline: decoding and encoding a FLAC
+// tune keep a core each instead of taking turns on one.
 class AudioFileProcessor
 {
 public:
-    AudioFileProcessor(File file, String tempExtension)
-        : file(file),
-        buffer(2, bufferSize),
-        channelInfo(buffer),
-        tempExtension(tempExtension)
+    static constexpr int defaultBlockBytes = 1 << 20;
+    static constexpr int numPipelineBlocks = 4; // in flight in copyRange()
+
+    // what a worker lends to each processor it runs, rather than every processor creating its own
+    struct SharedResources
     {
-        formatManager.registerBasicFormats();
-        channelInfo.numSamples = bufferSize;
+        SharedResources()
+        {
+            registerFormats(formatManager);
+        }
+
+        AudioFormatManager formatManager;
+        AudioSampleBuffer buffers[numPipelineBlocks];
+        int blockBytes = defaultBlockBytes;
+    };
+
+    static void registerFormats(AudioFormatManager &manager)
+    {
+        manager.registerFormat(new ParallelFlacAudioFormat(), false); // found before the FLAC format of registerBasicFormats()
+        manager.registerBasicFormats();
+    }
 
+    AudioFileProcessor(File file, String tempExtension, SharedResources *resources = nullptr)
+        : tempExtension(tempExtension),
+        file(file),
+        formatManager(resources != nullptr ? resources->formatManager : ownFormatManager),
+        buffers(resources != nullptr ? resources->buffers : ownBuffers),
+        buffer(buffers[0])
+    {
+        if (resources == nullptr)
+        {
+            registerFormats(ownFormatManager);
+        }
+        const int blockBytes = resources != nullptr ? resources->blockBytes : defaultBlockBytes;
 
         audioFormat = formatManager.findFormatForFileExtension(file.getFileExtension());
         // create a temp copy
         copy = File(file.getFullPathName() + tempExtension);
         copy.create();
-        reader = formatManager.createReaderFor(file);
-        newSource = new AudioFormatReaderSource(reader, false);
+        reader = createReader();
         if (reader != nullptr)
         {
+            bufferSize = getBlockSize(*reader, blockBytes);
+            buffer.setSize((int)reader->numChannels, bufferSize, false, false, true); // a shared buffer only grows
+
             // create writer
-            writer = audioFormat->createWriterFor(new FileOutputStream(copy, bufferSize), reader->sampleRate, reader->numChannels, reader->bitsPerSample, reader->metadataValues, 3);
+            writer = audioFormat->createWriterFor(new FileOutputStream(copy, (size_t)blockBytes), reader->sampleRate, reader->numChannels, reader->bitsPerSample, reader->metadataValues, 3);
         }
     }
 
-    ~AudioFileProcessor() {}
+    ~AudioFileProcessor()
+    {
+        delete writer;
+        delete reader;
+    }
 
-    void process() {
-        if (reader != nullptr)
+    // Returns true once the processed copy has replaced the file. When the file can't be read, the copy
+    // can't be written, or the pass fails (a full disk, a decoding error), the copy is deleted and the
+    // file left as it was.
+    bool process() {
+        const bool processed = reader != nullptr && writer != nullptr && processInternal();
+
+        // done, free files; the writer flushes once, as it closes
+        delete writer;
+        delete reader;
+        writer = nullptr;
+        reader = nullptr;
+
+        if (!processed)
         {
-            processInternal();
+            copy.deleteFile();
+            return false;
+        }
 
-            // done, free files
-            delete writer;
-            newSource->releaseResources();
-            delete newSource;
-            delete reader;
+        // delete original and rename copy
+        if (file.deleteFile())
+        {
+            return copy.moveFileTo(copy.getFullPathName().replace(tempExtension, "", false));
+        }
+        jassertfalse;
+        return false;
+    }
 
-            // delete original and rename copy
-            if (file.deleteFile())
-            {
-                copy.moveFileTo(copy.getFullPathName().replace(tempExtension, "", false));
-            }
-            else
+    // A crash during a treatment leaves its temp copy. The original is only deleted once the copy is
+    // closed: a copy without its original is complete and takes its place, any other one is dropped.
+    static void recoverInterruptedCopies(const File &file)
+    {
+        for (auto *tempExtension : { " - processing", " - normalising", " - trimming" }) // of the subclasses
+        {
+            const File copy(file.getFullPathName() + tempExtension);
+            if (copy.existsAsFile())
             {
-                jassertfalse;
+                if (file.existsAsFile())
+                    copy.deleteFile();
+                else
+                    copy.moveFileTo(file);
             }
         }
     }
+
+    // about blockBytes of the file per block, at least minBlockSize samples, and no more than the file
+    static int getBlockSize(const AudioFormatReader &reader, int blockBytes)
+    {
+        const int frameBytes = jmax(1, (int)reader.numChannels * (int)(reader.bitsPerSample / 8));
+        const int blockSize = jlimit(minBlockSize, maxBlockSize, blockBytes / frameBytes);
+        return (int)jmax((int64)1, jmin((int64)blockSize, reader.lengthInSamples));
+    }
+
 protected:
-    const int bufferSize = 4096;
+    static constexpr int minBlockSize = 4096;
+    static constexpr int maxBlockSize = 1 << 20;
+
+    int bufferSize = minBlockSize; // samples per block, see getBlockSize()
     const juce::String tempExtension;
     File file;
-    AudioFormatManager formatManager;
-    AudioSampleBuffer buffer;
-    AudioSourceChannelInfo channelInfo;
+    AudioFormatManager ownFormatManager;
+    AudioFormatManager &formatManager;
+    AudioSampleBuffer ownBuffers[numPipelineBlocks];
+    AudioSampleBuffer *buffers;
+    AudioSampleBuffer &buffer; // the first one, for the passes that only read
     AudioFormat* audioFormat;
-    AudioFormatReader* reader;
-    AudioFormatReaderSource* newSource;
-    AudioFormatWriter* writer;
+    AudioFormatReader* reader = nullptr;
+    AudioFormatWriter* writer = nullptr;
     File copy;
 
-    virtual void processInternal() = 0;
+    // false when a read or a write failed
+    virtual bool processInternal() = 0;
+
+    // a block of the file, into the start of the buffer
+    bool readBlock(int64 position, int numSamples)
+    {
+        return reader->read(&buffer, 0, numSamples, position, true, true);
+    }
+
+    // the DSP of a block of copyRange(), which starts position samples into the range
+    using BlockProcess = std::function<void(AudioSampleBuffer &block, int numSamples, int64 position)>;
+
+    // writes numSamples of the file from startSample into the copy, with a gain; false when a read or a write failed
+    bool copyRange(int64 startSample, int64 numSamples, float gain = 1.0f)
+    {
+        BlockProcess applyGain;
+        if (gain != 1.0f)
+        {
+            applyGain = [gain](AudioSampleBuffer &block, int length, int64) { block.applyGain(0, length, gain); };
+        }
+        return copyRange(startSample, numSamples, applyGain);
+    }
+
+    // without a process, the blocks go straight from the reader to the writer
+    bool copyRange(int64 startSample, int64 numSamples, const BlockProcess &process)
+    {
+        for (int i = 1; i < numPipelineBlocks; i++)
+        {
+            buffers[i].setSize(buffer.getNumChannels(), bufferSize, false, false, true);
+        }
+
+        auto getLength = [&](int64 blockIndex) { return (int)jmin((int64)bufferSize, numSamples - blockIndex * bufferSize); };
+        BlockPipeline::Stage processStage;
+        if (process != nullptr)
+        {
+            processStage = [&](AudioSampleBuffer &block, int64 blockIndex) {
+                process(block, getLength(blockIndex), blockIndex * bufferSize);
+                return true;
+            };
+        }
+
+        return BlockPipeline::run(
+            buffers, numPipelineBlocks, (numSamples + bufferSize - 1) / bufferSize,
+            [&](AudioSampleBuffer &block, int64 blockIndex) {
+                return reader->read(&block, 0, getLength(blockIndex), startSample + blockIndex * bufferSize, true, true);
+            },
+            processStage,
+            [&](AudioSampleBuffer &block, int64 blockIndex) {
+                return writer->writeFromAudioSampleBuffer(block, 0, getLength(blockIndex));
+            });
+    }
+
+private:
+    AudioFormatReader *createReader()
+    {
+        if (audioFormat != nullptr)
+        {
+            if (auto *mappedReader = audioFormat->createMemoryMappedReader(file))
+            {
+                if (mappedReader->mapEntireFile())
+                {
+                    return mappedReader;
+                }
+                delete mappedReader; // no address space for it
+            }
+        }
+        return formatManager.createReaderFor(file);
+    }
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioFileProcessor)
 };
\ No newline at end of file
@@ -1,96 +1,63 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "SilenceSearch.h"
 
 class AudioFileTrimer : public AudioFileProcessor
 {
 public:
-    AudioFileTrimer(File file, float threshold) :
-        AudioFileProcessor(file, " - trimming"),
+    AudioFileTrimer(File file, float threshold, SharedResources *resources = nullptr) :
+        AudioFileProcessor(file, " - trimming", resources),
         silenceThreshold(threshold)
     { }
 
-    void processInternal () {
-        newSource->prepareToPlay(bufferSize, reader->sampleRate);
-        newSource->setLooping(false);
+    bool processInternal () override {
+        const int64 length = reader->lengthInSamples;
 
-        int nbBeginingZeroSamples = 0, nbEndingZeroSamples = 0;
-        int samplesTreated = 0;
-        // first read once the file to know nb of samples to trim, from the begining
-        do
+        // first read the file forwards, by big blocks, up to the first sound
+        int64 firstSound = -1;
+        for (int64 start = 0; start < length && firstSound < 0; start += bufferSize)
         {
-            channelInfo.numSamples = (samplesTreated + bufferSize) > (int)newSource->getTotalLength() ?
-                (int)newSource->getTotalLength() - samplesTreated :
-                bufferSize;
-            newSource->getNextAudioBlock(channelInfo);
-
-            for (int i = 0; i < channelInfo.numSamples; ++i) 
+            const int numSamples = (int)jmin((int64)bufferSize, length - start);
+            if (!readBlock(start, numSamples))
+            {
+                return false;
+            }
+            const int index = SilenceSearch::findFirstSound(buffer.getArrayOfReadPointers(), buffer.getNumChannels(), numSamples, silenceThreshold);
+            if (index >= 0)
             {
-                // count the nb of silence sample at the beginning of the file
-                if (channelInfo.buffer->getMagnitude(i, 1) < silenceThreshold)
-                {
-                    ++nbBeginingZeroSamples;
-                }
-                else
-                {
-                    goto endLoop1;
-                }
+                firstSound = start + index;
             }
-            samplesTreated += channelInfo.numSamples;
-        } while (samplesTreated < (int)newSource->getTotalLength());
-    endLoop1:
-        // read once the file backwards to samples to trim from the end
-        samplesTreated = 0;
-        do
+        }
+
+        // then read the tail backwards, by big blocks too, down to the last sound; it is at or after the first one.
+        // Reading from the end of a FLAC file seeks: the SEEKTABLE of ParallelFlacWriter takes it straight to a near frame
+        int64 lastSound = -1;
+        for (int64 end = length; end > jmax((int64)0, firstSound) && lastSound < 0; end -= bufferSize)
         {
-            channelInfo.numSamples = (samplesTreated + bufferSize) > (int)newSource->getTotalLength() ?
-                (int)newSource->getTotalLength() - samplesTreated :
-                bufferSize;
-            newSource->setNextReadPosition(newSource->getTotalLength() - ((juce::int64)samplesTreated + channelInfo.numSamples));
-            newSource->getNextAudioBlock(channelInfo);
-            for (int i = channelInfo.numSamples - 1; i >= 0; --i) // backwards
+            const int64 start = jmax((int64)0, end - bufferSize);
+            const int numSamples = (int)(end - start);
+            if (!readBlock(start, numSamples))
+            {
+                return false;
+            }
+            const int index = SilenceSearch::findLastSound(buffer.getArrayOfReadPointers(), buffer.getNumChannels(), numSamples, silenceThreshold);
+            if (index >= 0)
             {
-                // count the nb of silence sample at the beginning of the file
-                if (channelInfo.buffer->getMagnitude(i, 1) < silenceThreshold)
-                {
-                    ++nbEndingZeroSamples;
-                }
-                else
-                {
-                    goto endLoop2;
-                }
+                lastSound = start + index;
             }
-            // reset play head pos
-            newSource->setNextReadPosition(newSource->getNextReadPosition() - ((juce::int64)2 * bufferSize));
-            samplesTreated += channelInfo.numSamples;
-        } while (samplesTreated < newSource->getTotalLength());
-    endLoop2:
+        }
+
+        // a file without sound is trimmed down to one sample
+        int64 nbBeginingZeroSamples = firstSound >= 0 ? firstSound : length;
+        int64 nbEndingZeroSamples = lastSound >= 0 ? length - 1 - lastSound : 0;
 
         // let at least one sample to 0
         nbBeginingZeroSamples = nbBeginingZeroSamples > 1 ? nbBeginingZeroSamples - 1 : 0;
         nbEndingZeroSamples = nbEndingZeroSamples > 1 ? nbEndingZeroSamples - 1 : 0;
 
-        // reset play head
-        newSource->setNextReadPosition(nbBeginingZeroSamples);
-        samplesTreated = 0;
-        int finalFileSize = (int)newSource->getTotalLength() - (nbBeginingZeroSamples + nbEndingZeroSamples);
         /// now reread the file and write it to the temp file, but start and stop before/after the silencess
-        do
-        {
-            channelInfo.numSamples = (samplesTreated + bufferSize) > finalFileSize ?
-                finalFileSize - samplesTreated :
-                bufferSize;
-            newSource->getNextAudioBlock(channelInfo);
-            if (writer->writeFromAudioSampleBuffer(*channelInfo.buffer, channelInfo.startSample, channelInfo.numSamples)) {
-                samplesTreated += channelInfo.numSamples;
-                writer->flush();
-            }
-            else { // should never happen
-                jassertfalse;
-                break;
-            }
-        } while (samplesTreated < finalFileSize);
-        
+        return copyRange(nbBeginingZeroSamples, length - (nbBeginingZeroSamples + nbEndingZeroSamples));
     }
 private:
     float silenceThreshold;
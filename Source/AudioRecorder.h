@@ -1,15 +1,26 @@
 #pragma once
 
 #include <atomic>
+#include <vector>
 #include <JuceHeader.h>
 #include "AudioFileNormalizer.h"
 #include "AudioFileTrimmer.h"
-#include "CircularBuffer.h"
+#include "CallbackProfiler.h"
+#include "ParallelFlacWriter.h"
 #include "PostRecordJob.h"
+#include "PostRecordScheduler.h"
+#include "RealtimeAllocationChecker.h"
+#include "RecorderEvents.h"
+#include "SessionJournal.h"
+#include "SilenceDetector.h"
+#include "SpillingWriter.h"
+#include "TuneStatistics.h"
+#include "WriterFactory.h"
 
 class AudioRecorder
     : public AudioIODeviceCallback,
-      public Timer
+      public Timer,
+      private RecorderControlThread::Client
 {
 public:
     enum class SupportedAudioFormat
@@ -24,14 +35,19 @@ public:
     {
         backgroundThread.startThread();
         formatManager.registerBasicFormats();
+        startTimer(40); // feeds the thumbnail
+        controlThread.start();
     }
 
     ~AudioRecorder() override
     {
-        stop();
-        applyPostRecordTreatment();
-
-        delete memoryBuffer;
+        controlThread.stop();
+        stopTimer();
+        preparesNextWriter = false;
+        auto lastWriter = releaseActiveWriter();
+        applyPostRecordTreatment(std::move(lastWriter), currentFile, tuneStatistics.getStatistics());
+        WriterFactory::discard(preparedWriter);
+        postRecordScheduler->finishJobsOf(this);
     }
 
     void initialize(String folder,
@@ -46,20 +62,33 @@ public:
         currentFolder = folder;
         selectedFormat = format;
         RMSThreshold = rmsThres;
+        detector.setThreshold(rmsThres);
         silenceLength = silenceLen;
         this->normalize = normalize;
         this->trim = trim;
         this->removeChunks = removeChunks;
         this->chunkMaxSize = chunkMaxSize;
+        openJournal();
+    }
+
+    // shared by all the recorders of the application
+    void setPostRecordOptions(const PostRecordScheduler::Options &options)
+    {
+        postRecordScheduler->setOptions(options);
     }
 
     AudioFormat *getAudioFormat()
     {
-        switch (selectedFormat)
+        return createAudioFormat(selectedFormat, seekPointInterval);
+    }
+
+    static AudioFormat *createAudioFormat(SupportedAudioFormat format, double seekPointInterval = ParallelFlacWriter::defaultSeekPointInterval)
+    {
+        switch (format)
         {
         default:
         case SupportedAudioFormat::flac:
-            return new FlacAudioFormat();
+            return new ParallelFlacAudioFormat(seekPointInterval);
             break;
         /*   case SupportedAudioFormat::mp3:
                     return new LAMEEncoderAudioFormat(File("")); // currently not supported
@@ -95,55 +124,161 @@ public:
 
     void startRecording()
     {
-        stop();
+        const ScopedLock sl(rotationLock);
+        recoverInterruptedTreatments();
+        auto previousWriter = releaseActiveWriter();
         if (shouldRestart) // it means we've ended a file , should do post-record treatment
         {
-            applyPostRecordTreatment();
+            // the job finishes writing the file on a post-record worker, so that the flush doesn't delay the new file
+            applyPostRecordTreatment(std::move(previousWriter), currentFile, tuneStatistics.getStatistics());
         }
-        currentFile = getNextFile();
+        previousWriter.reset();
 
         if (sampleRate > 0)
         {
-            // Create an OutputStream to write to our destination file...
-            if (auto fileStream = std::unique_ptr<FileOutputStream>(currentFile.createOutputStream()))
+            // the writer prepared in advance, or one prepared right now when there's none
+            auto prepared = std::move(preparedWriter);
+            if (prepared.writer == nullptr)
+            {
+                prepared = writerFactory.take(true);
+            }
+            if (prepared.writer == nullptr)
             {
-                AudioFormat *audioFormat = getAudioFormat();
+                writerFactory.request(getCreateWriterFunction());
+                prepared = writerFactory.take(true);
+            }
 
-                GetSupportedBitDepth(audioFormat);
+            if (prepared.writer != nullptr)
+            {
+                currentFile = prepared.file;
+                spillingWriter = std::move(prepared.writer);
+                tuneStatistics.reset(sampleRate, RMSThreshold); // the callback doesn't use it until the next writer is active
+                resetThumbnail();
+
+                // And now, swap over our active writer pointer so that the audio callback will start using it..
+                journalOpened(currentFile); // before the callback can write into it
+                ++writerGeneration;
+                activeWriter = spillingWriter.get();
+            }
 
-                if (auto writer = audioFormat->createWriterFor(fileStream.get(), sampleRate, nbInputChannels, bitDepth, {}, 3))
-                {
-                    fileStream.release(); // (passes responsibility for deleting the stream to the writer object that is now using it)
+            if (preparesNextWriter)
+            {
+                writerFactory.request(getCreateWriterFunction());
+                controlThread.wakeUp(); // which arms it once it's ready
+            }
+        }
+    }
 
-                    // Now we'll create one of these helper objects which will act as a FIFO buffer, and will
-                    // write the data to disk on our background thread.
-                    threadedWriter.reset(new AudioFormatWriter::ThreadedWriter(writer, backgroundThread, silenceTimeThreshold + 1)); // silenceTimeThreshold to be able to write all the memory buffer once
+    // on the control thread after each event: once a silence has ended a tune, takes care of the
+    // finished file, and gets the next one ready
+    void handlePendingRestart()
+    {
+        const ScopedLock sl(rotationLock);
+        if (!handleWriterSwap() && shouldRestart)
+        {
+            // there was no writer ready to swap to, the split waited for us
+            startRecording();
+            shouldRestart = false;
+        }
+        armPreparedWriter();
+    }
 
-                    // Reset our recording thumbnail
-                    thumbnail.reset(writer->getNumChannels(), writer->getSampleRate());
-                    nextSampleNum = 0;
+    // with false, each file is only created when the previous one ends, as a reference for the split latency
+    void setPreparesNextWriter(bool shouldPrepare)
+    {
+        preparesNextWriter = shouldPrepare;
+    }
 
-                    // And now, swap over our active writer pointer so that the audio callback will start using it..
-                    const ScopedLock sl(writerLock);
-                    activeWriter = threadedWriter.get();
-                }
-                delete audioFormat;
-            }
+    struct SplitLatency
+    {
+        int64 numSplits = 0;
+        double meanSeconds = 0;
+        double maxSeconds = 0;
+    };
+
+    // from the block where a silence ends a tune to the first block the next file could take
+    SplitLatency getSplitLatency() const noexcept
+    {
+        SplitLatency latency;
+        latency.numSplits = numSplits;
+        if (latency.numSplits > 0)
+        {
+            latency.meanSeconds = Time::highResolutionTicksToSeconds(totalSplitLatencyTicks) / (double)latency.numSplits;
         }
+        latency.maxSeconds = Time::highResolutionTicksToSeconds(maxSplitLatencyTicks);
+        return latency;
+    }
+
+    // the events the audio callback posts, delivered on the control thread
+    class Listener
+    {
+    public:
+        virtual ~Listener() = default;
+
+        virtual void recorderEventReceived(const RecorderEvent &event) = 0;
+    };
+
+    void addListener(Listener *listener)
+    {
+        listeners.add(listener);
+    }
+
+    // once it returns, the listener isn't called anymore
+    void removeListener(Listener *listener)
+    {
+        listeners.remove(listener);
+    }
+
+    // returns once the control thread has handled the events posted so far
+    void waitUntilEventsHandled()
+    {
+        controlThread.waitUntilHandled();
+    }
+
+    // the events that didn't fit in the queue, since the recorder was created
+    int64 getNumLostEvents() const noexcept
+    {
+        return controlThread.getNumLostEvents();
     }
 
     void stop()
     {
-        // First, clear this pointer to stop the audio callback from using our writer object..
-        {
-            const ScopedLock sl(writerLock);
-            activeWriter = nullptr;
-        }
+        // Detach the writer from the audio callback first, then delete it. The deletion could
+        // take a little time while remaining data gets flushed to disk, the callback never waits for it.
+        const ScopedLock sl(rotationLock);
+        releaseActiveWriter().reset();
+    }
+
+    // how much audio can wait in memory when the disk stalls, on top of the pre-roll
+    void setSpillBufferLength(float seconds)
+    {
+        spillBufferLength = jmax(0.0f, seconds);
+    }
+
+    // normalize brings each tune to the target integrated loudness, measured while it is written, rather than its peak to 0.99
+    void setLoudnessNormalization(bool enabled, float targetLoudness)
+    {
+        normalizeLoudness = enabled;
+        loudnessTarget = targetLoudness;
+    }
+
+    // the seconds between the points of the SEEKTABLE of the FLAC files, none with 0
+    void setSeekPointInterval(double seconds)
+    {
+        seekPointInterval = jmax(0.0, seconds);
+    }
+
+    // the samples lost because the spill buffer was full, since the recorder was created; any thread,
+    // as of the last time the control thread looked (an overflow wakes it up)
+    int64 getNumDroppedSamples() const noexcept
+    {
+        return numDroppedSamples.load(std::memory_order_relaxed);
+    }
 
-        // Now we can delete the writer object. It's done in this order because the deletion could
-        // take a little time while remaining data gets flushed to disk, so it's best to avoid blocking
-        // the audio callback while this happens.
-        threadedWriter.reset();
+    // the fullest the spill buffer of a finished file has been, in seconds
+    double getSpillHighWaterMark() const noexcept
+    {
+        return spillHighWaterMark;
     }
 
     void mute(bool isMuted)
@@ -154,12 +289,29 @@ public:
     //==============================================================================
     void audioDeviceAboutToStart(AudioIODevice *device) override
     {
-        sampleRate = (int)device->getCurrentSampleRate();
+        prepareToRecord(device->getActiveInputChannels().countNumberOfSetBits(), device->getCurrentSampleRate(),
+                        device->getCurrentBitDepth(), device->getCurrentBufferSizeSamples());
+    }
+
+    // audioDeviceAboutToStart() for a part of the input channels of the device, see ChannelGroupRecorder
+    void prepareToRecord(int numInputChannels, double deviceSampleRate, int deviceBitDepth, int bufferSize)
+    {
+        sampleRate = (int)deviceSampleRate;
         silenceTimeThreshold = (int)(sampleRate * silenceLength);
-        bitDepth = device->getCurrentBitDepth();
-        nbInputChannels = device->getActiveInputChannels().toInteger();
-        memoryBuffer = new CircularBuffer<float>(nbInputChannels, silenceTimeThreshold);
-        tempBuffer = AudioBuffer<float>(memoryBuffer->getNumChannels(), memoryBuffer->getSize());
+        bitDepth = deviceBitDepth;
+        nbInputChannels = numInputChannels;
+
+        // everything the audio callback needs is allocated here, the callback itself never allocates
+        detector.prepare(nbInputChannels, silenceTimeThreshold);
+        profiler.prepare(bufferSize, deviceSampleRate);
+        spillBufferPool.preallocate(nbInputChannels, getSpillBufferSize());
+        lastNumOverruns = 0;
+        samplePosition = 0;
+
+        const ScopedLock sl(thumbnailLock);
+        thumbnailBuffer.setSize(nbInputChannels, sampleRate); // one second, drained every 40 ms
+        thumbnailFifo.setTotalSize(sampleRate);
+        thumbnailFifo.reset();
     }
 
     void audioDeviceStopped() override
@@ -172,24 +324,38 @@ public:
                                float **outputChannelData, int numOutputChannels,
                                int numSamples) override
     {
-        const ScopedLock sl(writerLock);
+        const RealtimeAllocationChecker::ScopedRealtimeSection realtimeSection;
+        const CallbackProfiler::ScopedPhase callbackPhase(profiler, CallbackProfiler::wholeCallback);
+
+        // odd while the callback runs, see releaseActiveWriter()
+        ++callbackSequence;
+        auto *writer = activeWriter.load();
 
         // Create an AudioBuffer to wrap our incoming data, note that this does no allocations or copies, it simply references our input data
         AudioBuffer<float> buffer(const_cast<float **>(inputChannelData), numInputChannels, numSamples);
 
-        if (activeWriter.load() != nullptr)
+        if (writer != nullptr)
         {
-            handleLevel(buffer);
+            handleLevel(buffer, writer);
+            measureSplitLatency();
             if (shouldWriteMemory)
             {
-                writeMemoryIntoFile();
+                writeMemoryIntoFile(writer);
             }
 
-            if (!isSilence)
+            if (!detector.isSilence())
             {
                 if (!shouldWriteMemory)
                 {
-                    activeWriter.load()->write(inputChannelData, numSamples);
+                    const CallbackProfiler::ScopedPhase writePhase(profiler, CallbackProfiler::writerWrite);
+                    if (writer->write(inputChannelData, numSamples))
+                    {
+                        tuneStatistics.addBlock(inputChannelData, numInputChannels, numSamples);
+                    }
+                    else
+                    {
+                        postOverflow();
+                    }
                 }
                 else
                 {
@@ -199,19 +365,22 @@ public:
                 // clip detection
                 if (buffer.getMagnitude(0, numSamples) > 0.99)
                 {
-                    clip = true;
-                    startTimer(200);
+                    lastClipTime = Time::getMillisecondCounter();
+                    if (!clip.exchange(true))
+                    {
+                        postEvent(RecorderEvent::Type::clipStarted);
+                    }
                 }
             }
         }
 
-        // handle display
-        if (numInputChannels >= thumbnail.getNumChannels())
+        // handle display: the thumbnail allocates and locks, it is fed on the message thread
         {
-            thumbnail.addBlock(nextSampleNum, buffer, 0, numSamples);
-            nextSampleNum += numSamples;
+            const CallbackProfiler::ScopedPhase thumbnailPhase(profiler, CallbackProfiler::thumbnailPush);
+            pushToThumbnailFifo(buffer);
         }
 
+        const CallbackProfiler::ScopedPhase monitoringPhase(profiler, CallbackProfiler::monitoringCopy);
         if (numInputChannels == numOutputChannels && !muted)
         {
             // not muted, send input to output
@@ -225,12 +394,25 @@ public:
                 if (outputChannelData[i] != nullptr)
                     FloatVectorOperations::clear(outputChannelData[i], numSamples);
         }
+
+        samplePosition.fetch_add(numSamples, std::memory_order_relaxed);
+        ++callbackSequence;
     }
 
     void timerCallback() override
     {
-        clip = false;
-        stopTimer();
+        drainThumbnailFifo();
+
+        if (++numTimerCallbacks % 25 == 0)
+        {
+            logCallbackOverruns();
+        }
+    }
+
+    // the timing of the audio callback phases since the device started
+    CallbackProfiler::Snapshot getCallbackProfile() const noexcept
+    {
+        return profiler.getSnapshot();
     }
 
     File getCurrentFolder()
@@ -240,36 +422,47 @@ public:
 
     void setCurrentFolder(File folder)
     {
+        const ScopedLock sl(rotationLock);
         currentFolder = folder.getFullPathName();
+        openJournal();
         reCreateFileIfSilence();
     }
 
     void setCurrentFormat(AudioRecorder::SupportedAudioFormat format)
     {
+        const ScopedLock sl(rotationLock);
         selectedFormat = format;
         reCreateFileIfSilence();
     }
 
     void reCreateFileIfSilence()
     {
-        if (isSilence)
+        const ScopedLock sl(rotationLock);
+        if (detector.isSilence())
         {
             stop();
             currentFile.deleteFile();
+            if (auto currentJournal = getJournal(currentFile.getParentDirectory()))
+                currentJournal->fileRemoved(currentFile);
+            // the next files were prepared with the former settings
+            WriterFactory::discard(preparedWriter);
+            auto pending = writerFactory.take(true);
+            WriterFactory::discard(pending);
             startRecording();
         }
     }
 
     std::atomic_bool shouldRestart{false};
-    std::atomic_bool clip{false};
 
 private:
-    File getNextFile()
+    static constexpr uint32 clipHoldTime = 200; // ms the clip indicator stays after the last clipping block
+    static constexpr uint32 checkpointInterval = 5000; // ms between the sample counts written to the journal
+
+    static File getNextFile(const File &documentsDir, SupportedAudioFormat format)
     {
-        auto documentsDir = File(currentFolder);
         documentsDir.createDirectory(); // if not exists
         String extension = "";
-        switch (selectedFormat)
+        switch (format)
         {
         case SupportedAudioFormat::wav:
             extension = ".wav";
@@ -286,57 +479,451 @@ private:
 
         return documentsDir.getNonexistentChildFile(String("Tune "), extension, false);
     }
-    void handleLevel(const AudioBuffer<float> &buffer)
+    // The first time a folder is used in the session, reads the journal the former session left in it;
+    // what it left unfinished is recovered once the recording starts (see recoverInterruptedTreatments())
+    void openJournal()
+    {
+        const ScopedLock sl(rotationLock);
+        const File folder(currentFolder);
+        if (getJournal(folder) != nullptr)
+        {
+            return; // its files belong to this session
+        }
+
+        PendingRecovery pending;
+        pending.folder = folder;
+        journals.add(new SessionJournal(folder, pending.recovery));
+        pendingRecoveries.push_back(std::move(pending));
+    }
+
+    // Finishes in the background what a crash may have interrupted: the in place gains, then the
+    // treatments of the tunes that were being recorded or treated, a job each. Called when the recording
+    // starts, so that the jobs get all the settings: initialize() comes before the other setters.
+    void recoverInterruptedTreatments()
+    {
+        for (auto &pending : pendingRecoveries)
+        {
+            const File folder(pending.folder);
+            const auto recovery = pending.recovery;
+            postRecordScheduler->addTask(folder, [this, folder, recovery] {
+                WavInPlaceGain::recoverPendingFiles(folder);
+                SessionJournal::finish(recovery, [this](const File &file) {
+                    const ScopedLock sl(rotationLock);
+                    postRecordScheduler->addJob(createPostRecordJob(nullptr, file, TuneStatistics()), this);
+                });
+            }, this);
+        }
+        pendingRecoveries.clear();
+    }
+
+    // the journal of a folder, once openJournal() opened it
+    SessionJournal::Ptr getJournal(const File &folder) const
+    {
+        for (auto *journal : journals)
+        {
+            if (journal->getFolder() == folder)
+            {
+                return journal;
+            }
+        }
+        return nullptr;
+    }
+
+    void journalOpened(const File &file)
+    {
+        if (auto journal = getJournal(file.getParentDirectory()))
+        {
+            journal->fileOpened(file);
+        }
+    }
+
+    // every checkpointInterval while a file is recorded; returns the ms until the next one, -1 without a file
+    int checkpointJournal()
+    {
+        const ScopedLock sl(rotationLock);
+        auto journal = getJournal(currentFile.getParentDirectory());
+        if (journal == nullptr || spillingWriter == nullptr)
+        {
+            return -1;
+        }
+
+        const uint32 sinceLastCheckpoint = Time::getMillisecondCounter() - lastCheckpointTime;
+        if (sinceLastCheckpoint < checkpointInterval)
+        {
+            return (int)(checkpointInterval - sinceLastCheckpoint);
+        }
+        journal->checkpoint(currentFile, spillingWriter->getNumSamplesWritten());
+        lastCheckpointTime = Time::getMillisecondCounter();
+        return (int)checkpointInterval;
+    }
+
+    void pushToThumbnailFifo(const AudioBuffer<float> &buffer)
+    {
+        const int numChannels = jmin(buffer.getNumChannels(), thumbnailBuffer.getNumChannels());
+        int start1, size1, start2, size2;
+        thumbnailFifo.prepareToWrite(buffer.getNumSamples(), start1, size1, start2, size2);
+
+        for (int i = 0; i < numChannels; i++)
+        {
+            thumbnailBuffer.copyFrom(i, start1, buffer, i, 0, size1);
+            thumbnailBuffer.copyFrom(i, start2, buffer, i, size1, size2);
+        }
+        // when the message thread is late the display simply misses a block
+        thumbnailFifo.finishedWrite(size1 + size2);
+    }
+
+    void drainThumbnailFifo()
     {
-        memoryBuffer->push(buffer);
-        if (memoryBuffer->isBufferFull())
+        const ScopedLock sl(thumbnailLock);
+        int start1, size1, start2, size2;
+        thumbnailFifo.prepareToRead(thumbnailFifo.getNumReady(), start1, size1, start2, size2);
+
+        if (thumbnailBuffer.getNumChannels() >= thumbnail.getNumChannels())
         {
-            float rmsLevel = memoryBuffer->getRMSLevel();
-            if (!isSilence && rmsLevel < RMSThreshold)
+            if (size1 > 0)
+                thumbnail.addBlock(nextSampleNum, thumbnailBuffer, start1, size1);
+            if (size2 > 0)
+                thumbnail.addBlock(nextSampleNum + size1, thumbnailBuffer, start2, size2);
+            nextSampleNum += size1 + size2;
+        }
+        thumbnailFifo.finishedRead(size1 + size2);
+    }
+
+    // the file of the next tune, opened with the current settings; runs on the writer factory thread
+    WriterFactory::CreateFunction getCreateWriterFunction()
+    {
+        std::unique_ptr<AudioFormat> audioFormat(getAudioFormat());
+        GetSupportedBitDepth(audioFormat.get());
+
+        const File folder(currentFolder);
+        const auto format = selectedFormat;
+        const double interval = seekPointInterval;
+        const bool measureLoudness = normalize && normalizeLoudness;
+        const int numChannels = nbInputChannels, rate = sampleRate, depth = bitDepth, bufferSize = getSpillBufferSize();
+        auto journal = getJournal(folder);
+
+        return [this, folder, format, interval, measureLoudness, numChannels, rate, depth, bufferSize, journal] {
+            WriterFactory::PreparedWriter prepared;
+            prepared.file = getNextFile(folder, format);
+            prepared.journal = journal;
+            if (journal != nullptr)
+            {
+                journal->filePrepared(prepared.file); // before the file exists
+            }
+
+            // Create an OutputStream to write to our destination file...
+            if (auto fileStream = std::unique_ptr<FileOutputStream>(prepared.file.createOutputStream()))
+            {
+                std::unique_ptr<AudioFormat> audioFormat(createAudioFormat(format, interval));
+                if (auto writer = audioFormat->createWriterFor(fileStream.get(), rate, (unsigned int)numChannels, depth, {}, 3))
+                {
+                    fileStream.release(); // (passes responsibility for deleting the stream to the writer object that is now using it)
+
+                    // Now we'll create one of these helper objects which will act as a FIFO buffer, and will
+                    // write the data to disk on our background thread.
+                    prepared.writer.reset(new SpillingWriter(writer, backgroundThread, spillBufferPool, bufferSize, measureLoudness));
+                }
+            }
+            return prepared;
+        };
+    }
+
+    // offers the prepared writer to the audio callback, which swaps to it when a silence ends a tune
+    void armPreparedWriter()
+    {
+        if (preparesNextWriter && preparedWriter.writer == nullptr && activeWriter.load() != nullptr)
+        {
+            preparedWriter = writerFactory.take(true); // nothing else waits for the control thread meanwhile
+            standbyWriter = preparedWriter.writer.get();
+        }
+    }
+
+    // after the audio callback swapped to the prepared writer: the finished file goes to its treatment
+    bool handleWriterSwap()
+    {
+        if (!writerSwapped.exchange(false, std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        auto finishedWriter = std::move(spillingWriter);
+        const File finishedFile = currentFile;
+        reportSpillStatistics(*finishedWriter);
+
+        spillingWriter = std::move(preparedWriter.writer);
+        currentFile = preparedWriter.file;
+        journalOpened(currentFile); // not when it was armed: until the swap, a crash leaves it unused
+        resetThumbnail();
+
+        applyPostRecordTreatment(std::move(finishedWriter), finishedFile, finishedStatistics);
+        if (preparesNextWriter)
+        {
+            writerFactory.request(getCreateWriterFunction());
+        }
+        return true;
+    }
+
+    void resetThumbnail()
+    {
+        const ScopedLock sl(thumbnailLock);
+        thumbnail.reset(nbInputChannels, sampleRate);
+        nextSampleNum = 0;
+    }
+
+    void handleLevel(const AudioBuffer<float> &buffer, SpillingWriter *&writer)
+    {
+        SilenceDetector::Event event;
+        {
+            const CallbackProfiler::ScopedPhase pushPhase(profiler, CallbackProfiler::ringPush);
+            detector.push(buffer);
+        }
+        {
+            const CallbackProfiler::ScopedPhase levelPhase(profiler, CallbackProfiler::rmsLevel);
+            event = detector.evaluate();
+        }
+
+        switch (event)
+        {
+        case SilenceDetector::Event::silenceStarted:
+            splitStartTicks = Time::getHighResolutionTicks();
+            splitWriterGeneration = writerGeneration.load();
+
+            if (auto *nextWriter = standbyWriter.exchange(nullptr))
+            {
+                // the next file is ready: the split is a pointer swap, the message thread closes the finished one
+                finishedStatistics = tuneStatistics.getStatistics();
+                tuneStatistics.reset(sampleRate, RMSThreshold);
+                ++writerGeneration;
+                activeWriter = nextWriter;
+                writer = nextWriter;
+                writerSwapped.store(true, std::memory_order_release);
+            }
+            else
             {
                 // restart
-                isSilence = true;
                 shouldRestart = true;
             }
-            else if (isSilence && rmsLevel > RMSThreshold)
+            postEvent(RecorderEvent::Type::silenceStarted);
+            break;
+        case SilenceDetector::Event::soundStarted:
+            shouldWriteMemory = true;
+            postEvent(RecorderEvent::Type::soundStarted);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // audio thread
+    void postEvent(RecorderEvent::Type type) noexcept
+    {
+        RecorderEvent event;
+        event.type = type;
+        event.samplePosition = samplePosition.load(std::memory_order_relaxed);
+        controlThread.post(event);
+    }
+
+    // audio thread: one event until the control thread has seen it, not one per dropped block
+    void postOverflow() noexcept
+    {
+        if (!overflowPosted.exchange(true))
+        {
+            postEvent(RecorderEvent::Type::overflow);
+        }
+    }
+
+    //==============================================================================
+    // control thread
+    void handleEvent(const RecorderEvent &event) override
+    {
+        if (event.type == RecorderEvent::Type::overflow)
+        {
+            overflowPosted = false;
+            Logger::writeToLog("The spill buffer is full, the disk doesn't keep up: samples are being dropped");
+        }
+        listeners.call([&event](Listener &listener) { listener.recorderEventReceived(event); });
+    }
+
+    int handleIdle() override
+    {
+        // the rotation is done here rather than for each silence event, so that a lost event only delays it
+        handlePendingRestart();
+        publishNumDroppedSamples();
+        const int untilCheckpoint = checkpointJournal();
+
+        if (!clip)
+        {
+            return untilCheckpoint;
+        }
+
+        const uint32 sinceLastClip = Time::getMillisecondCounter() - lastClipTime;
+        if (sinceLastClip < clipHoldTime)
+        {
+            const int untilClipEnd = (int)(clipHoldTime - sinceLastClip);
+            return untilCheckpoint < 0 ? untilClipEnd : jmin(untilCheckpoint, untilClipEnd);
+        }
+
+        clip = false;
+        RecorderEvent event;
+        event.type = RecorderEvent::Type::clipEnded;
+        event.samplePosition = samplePosition.load(std::memory_order_relaxed);
+        listeners.call([&event](Listener &listener) { listener.recorderEventReceived(event); });
+        return untilCheckpoint;
+    }
+
+    // Detaches the writer from the audio callback without ever making the callback wait: the pointer
+    // is cleared, then we wait (on this thread) for a callback that may still hold the old pointer to
+    // return. The caller gets the writer back and decides where it gets flushed and deleted.
+    std::unique_ptr<SpillingWriter> releaseActiveWriter()
+    {
+        // The callback mustn't swap to the prepared writer anymore, and a swap it already did is accounted for first
+        standbyWriter = nullptr;
+        waitForAudioCallback();
+        handleWriterSwap();
+
+        // First, clear this pointer to stop the audio callback from using our writer object..
+        activeWriter = nullptr;
+        waitForAudioCallback();
+
+        if (spillingWriter != nullptr)
+        {
+            reportSpillStatistics(*spillingWriter);
+        }
+        auto writer = std::move(spillingWriter);
+        publishNumDroppedSamples();
+        return writer;
+    }
+
+    void waitForAudioCallback()
+    {
+        const auto sequence = callbackSequence.load();
+        if ((sequence & 1) != 0)
+        {
+            while (callbackSequence.load() == sequence)
             {
-                isSilence = false;
-                shouldWriteMemory = true;
+                Thread::yield();
             }
         }
     }
 
-    void applyPostRecordTreatment()
+    // audio thread: the first block a new file gets after a split
+    void measureSplitLatency() noexcept
     {
-        postRecordFile = currentFile;
-        if (postRecordFile.existsAsFile())
+        if (splitStartTicks != 0 && writerGeneration.load() != splitWriterGeneration)
         {
-            PostRecordJob *job =
-                new PostRecordJob(
-                    postRecordFile,
-                    normalize,
-                    trim,
-                    removeChunks,
-                    &formatManager,
-                    RMSThreshold,
-                    chunkMaxSize);
-            pool.addJob((ThreadPoolJob *)job, true);
+            const int64 latency = Time::getHighResolutionTicks() - splitStartTicks;
+            splitStartTicks = 0;
+            totalSplitLatencyTicks += latency;
+            if (latency > maxSplitLatencyTicks)
+            {
+                maxSplitLatencyTicks = latency;
+            }
+            ++numSplits;
         }
     }
 
-    void writeMemoryIntoFile()
+    // the writer was detached: its counters are final
+    void reportSpillStatistics(const SpillingWriter &writer)
     {
-        // take back, write the buffer history
-        //activeWriter.load()->write(memoryBuffer);
-        for (int i = 0; i < memoryBuffer->getNumChannels(); i++)
+        const double highWaterMark = writer.getHighWaterMark() / writer.getSampleRate();
+        spillHighWaterMark = jmax(spillHighWaterMark.load(), highWaterMark);
+        numDroppedSamplesOfFinishedFiles += writer.getNumDroppedSamples();
+
+        if (writer.getNumDroppedSamples() > 0)
+        {
+            Logger::writeToLog(currentFile.getFileName() + ": " + String(writer.getNumDroppedSamples())
+                               + " samples lost, the disk didn't keep up with a " + String(writer.getBufferSize() / writer.getSampleRate(), 1)
+                               + " s spill buffer");
+        }
+        else if (writer.getHighWaterMark() > writer.getBufferSize() / 2)
         {
-            // first from origin to the end
-            tempBuffer.copyFrom(i, 0, memoryBuffer->getRaw(), i, memoryBuffer->getOrigin(), memoryBuffer->getSize() - memoryBuffer->getOrigin());
-            // then from 0 to origin
-            tempBuffer.copyFrom(i, memoryBuffer->getSize() - memoryBuffer->getOrigin(), memoryBuffer->getRaw(), i, 0, memoryBuffer->getOrigin());
+            Logger::writeToLog(currentFile.getFileName() + ": the spill buffer was up to " + String(highWaterMark, 1) + " s full");
         }
+    }
+
+    // the writers belong to the control thread, or to whoever holds rotationLock: the other threads only see the total
+    void publishNumDroppedSamples()
+    {
+        const ScopedLock sl(rotationLock);
+        const int64 numDroppedOfCurrentFile = spillingWriter != nullptr ? spillingWriter->getNumDroppedSamples() : 0;
+        numDroppedSamples.store(numDroppedSamplesOfFinishedFiles + numDroppedOfCurrentFile, std::memory_order_relaxed);
+    }
 
-        activeWriter.load()->write(tempBuffer.getArrayOfReadPointers(), memoryBuffer->getSize());
+    int getSpillBufferSize() const noexcept
+    {
+        // the pre-roll is written at once when a tune starts
+        return silenceTimeThreshold + 1 + (int)(spillBufferLength * (float)sampleRate);
+    }
+
+    // every second, on the message thread: says which phases were slow when the callback missed its deadline
+    void logCallbackOverruns()
+    {
+        const auto profile = profiler.getSnapshot();
+        if (profile.numOverruns == lastNumOverruns)
+        {
+            return;
+        }
+
+        String message;
+        message << (int)(profile.numOverruns - lastNumOverruns) << " audio callback overrun(s), "
+                << (int)profile.numNearMisses << " near-misses so far; longest phases in % of the "
+                << String(profile.deadlineSeconds * 1000.0, 2) << " ms deadline:";
+        for (int phase = 0; phase < CallbackProfiler::numPhases; phase++)
+        {
+            message << " " << CallbackProfiler::getPhaseName(phase) << " " << String(profile.phases[phase].maxFraction * 100.0, 1);
+        }
+        Logger::writeToLog(message);
+        lastNumOverruns = profile.numOverruns;
+    }
+
+    void applyPostRecordTreatment(std::unique_ptr<SpillingWriter> writerToClose, const File &fileToTreat, const TuneStatistics &statistics)
+    {
+        postRecordFile = fileToTreat;
+        if (postRecordFile.existsAsFile())
+        {
+            postRecordScheduler->addJob(createPostRecordJob(std::move(writerToClose), postRecordFile, statistics), this);
+        }
+    }
+
+    // the treatment of a tune, with the current settings
+    std::unique_ptr<PostRecordJob> createPostRecordJob(std::unique_ptr<SpillingWriter> writerToClose, const File &fileToTreat, const TuneStatistics &statistics)
+    {
+        return std::unique_ptr<PostRecordJob>(
+            new PostRecordJob(
+                std::move(writerToClose),
+                fileToTreat,
+                statistics,
+                normalize,
+                trim,
+                removeChunks,
+                &formatManager,
+                RMSThreshold,
+                chunkMaxSize,
+                normalizeLoudness,
+                loudnessTarget,
+                getJournal(fileToTreat.getParentDirectory())));
+    }
+
+    void writeMemoryIntoFile(SpillingWriter *writer)
+    {
+        const CallbackProfiler::ScopedPhase flushPhase(profiler, CallbackProfiler::preRollFlush);
+
+        // take back, write the buffer history straight from the ring: first from origin to the end, then from 0 to origin
+        auto &memoryBuffer = detector.getMemory();
+        CircularBuffer<float>::Segment oldest, newest;
+        memoryBuffer.getSegments(oldest, newest);
+
+        for (auto *segment : { &oldest, &newest })
+        {
+            if (writer->write(segment->channels, segment->numSamples))
+            {
+                tuneStatistics.addBlock(segment->channels, memoryBuffer.getNumChannels(), segment->numSamples);
+            }
+            else
+            {
+                postOverflow();
+            }
+        }
     }
 
     String currentFolder;
@@ -345,30 +932,78 @@ private:
     SupportedAudioFormat selectedFormat;
     AudioThumbnail &thumbnail;
     TimeSliceThread backgroundThread{"Audio Recorder Thread"};         // the thread that will write our audio data to disk
-    std::unique_ptr<AudioFormatWriter::ThreadedWriter> threadedWriter; // the FIFO used to buffer the incoming data
+    SpillBufferPool spillBufferPool;                                   // declared before the writers, which give their buffer back
+    std::unique_ptr<SpillingWriter> spillingWriter;                    // the FIFO used to buffer the incoming data
     int sampleRate = 0;
     int bitDepth = 0;
     int nbInputChannels = 0;
     int64 nextSampleNum = 0;
 
-    CriticalSection writerLock;
-    std::atomic<AudioFormatWriter::ThreadedWriter *> activeWriter{nullptr};
+    std::atomic<SpillingWriter *> activeWriter{nullptr};
+    std::atomic<SpillingWriter *> standbyWriter{nullptr};              // the prepared writer, while the callback may swap to it
+    std::atomic<bool> writerSwapped{false};
+    std::atomic<uint32> writerGeneration{0};                           // bumped whenever activeWriter gets a new writer
+    TuneStatistics finishedStatistics;                                 // of the file the callback swapped from
+    WriterFactory writerFactory;
+    WriterFactory::PreparedWriter preparedWriter;
+    bool preparesNextWriter = true;
+
+    // split latency, written by the audio thread
+    int64 splitStartTicks = 0;
+    uint32 splitWriterGeneration = 0;
+    std::atomic<int64> numSplits{0};
+    std::atomic<int64> totalSplitLatencyTicks{0};
+    std::atomic<int64> maxSplitLatencyTicks{0};
+    std::atomic<uint32> callbackSequence{0};
     std::atomic<bool> muted{true};
     std::atomic<float> RMSThreshold;
     std::atomic<bool> shouldWriteMemory{false};
-    CircularBuffer<float> *memoryBuffer = nullptr;
-    AudioBuffer<float> tempBuffer;
+    std::atomic<uint32> lastClipTime{0};
+    uint32 lastCheckpointTime = 0;
+    std::atomic_bool clip{false};
+    std::atomic_bool overflowPosted{false};
+    std::atomic<int64> samplePosition{0};
+    SilenceDetector detector;
+    CallbackProfiler profiler;
+    uint32 lastNumOverruns = 0;
+    int numTimerCallbacks = 0;
+    TuneStatisticsAccumulator tuneStatistics; // of the samples written to the current file, by the audio thread
+
+    // lock-free handoff of the incoming audio to the thumbnail, which is only touched on the message thread
+    CriticalSection thumbnailLock;
+    AbstractFifo thumbnailFifo{1};
+    AudioBuffer<float> thumbnailBuffer;
 
     float silenceLength;
     int silenceTimeThreshold = 10000;
-    bool isSilence = true;
+    float spillBufferLength = 30.0f;
+    double seekPointInterval = ParallelFlacWriter::defaultSeekPointInterval;
+    bool normalizeLoudness = false;
+    float loudnessTarget = PostRecordJob::defaultLoudnessTarget;
+    int64 numDroppedSamplesOfFinishedFiles = 0; // under rotationLock
+    std::atomic<int64> numDroppedSamples{0};    // published by publishNumDroppedSamples()
+    std::atomic<double> spillHighWaterMark{0};
 
     bool normalize;
     bool trim;
     bool removeChunks;
     int chunkMaxSize;
     AudioFormatManager formatManager;
-    ThreadPool pool;
+    SharedResourcePointer<PostRecordScheduler> postRecordScheduler;
+    ReferenceCountedArray<SessionJournal> journals; // of the folders used in the session
+
+    struct PendingRecovery
+    {
+        File folder;
+        SessionJournal::Recovery recovery;
+    };
+    std::vector<PendingRecovery> pendingRecoveries; // until the recording starts
+
+    // file rotation and post-record scheduling happen on the control thread, the settings change on the
+    // message thread: the lock keeps them apart
+    CriticalSection rotationLock;
+    ListenerList<Listener, Array<Listener *, CriticalSection>> listeners;
+    RecorderControlThread controlThread{*this};
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(AudioRecorder);
 };
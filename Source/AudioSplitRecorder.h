@@ -51,9 +51,11 @@
 #include "AudioLiveScrollingDisplay.h"
 #include "RecordingThumbnail.h"
 #include "AudioRecorder.h"
+#include "ChannelGroupRecorder.h"
 
 class AudioSplitRecorder  : public Component,
-                            private Timer,
+                            private AsyncUpdater,
+                            private AudioRecorder::Listener,
                             public Button::Listener
 {
 public:
@@ -88,6 +90,9 @@ public:
         formatComboBox.setSelectedId(applicationProperties.getUserSettings()->getIntValue("format", 1) + 1);
         formatComboBox.onChange = [this] { recorder.setCurrentFormat((AudioRecorder::SupportedAudioFormat)(formatComboBox.getSelectedId() - 1)); };
 
+       // e.g. "1-2,3-4" to record two decks plugged in the same interface, each in its own folder
+       recorder.setChannelGroups(ChannelGroupRecorder::parseChannelGroups(applicationProperties.getUserSettings()->getValue("channelGroups")));
+
        recorder.initialize(
            applicationProperties.getUserSettings()->getValue("folder"),
            (AudioRecorder::SupportedAudioFormat)applicationProperties.getUserSettings()->getIntValue("format", 1),
@@ -98,6 +103,18 @@ public:
            applicationProperties.getUserSettings()->getBoolValue("removeChunks", true),
            applicationProperties.getUserSettings()->getIntValue("chunkMaxSize", 10)
        );
+       recorder.setSpillBufferLength((float)applicationProperties.getUserSettings()->getDoubleValue("spillBufferLength", 30));
+       recorder.setLoudnessNormalization(applicationProperties.getUserSettings()->getBoolValue("loudnessNormalization", false),
+                                         (float)applicationProperties.getUserSettings()->getDoubleValue("loudnessTarget", PostRecordJob::defaultLoudnessTarget));
+       recorder.setSeekPointInterval(applicationProperties.getUserSettings()->getDoubleValue("seekPointInterval", ParallelFlacWriter::defaultSeekPointInterval));
+
+       PostRecordScheduler::Options postRecordOptions;
+       postRecordOptions.numWorkers = applicationProperties.getUserSettings()->getIntValue("postRecordWorkers", 2);
+       postRecordOptions.maxQueuedJobs = applicationProperties.getUserSettings()->getIntValue("postRecordQueueLength", 32);
+       postRecordOptions.maxJobsPerDisk = applicationProperties.getUserSettings()->getIntValue("postRecordJobsPerDisk", 1);
+       postRecordOptions.newestFirst = applicationProperties.getUserSettings()->getBoolValue("postRecordNewestFirst", false);
+       postRecordOptions.blockBytes = applicationProperties.getUserSettings()->getIntValue("postRecordBlockBytes", AudioFileProcessor::defaultBlockBytes);
+       recorder.setPostRecordOptions(postRecordOptions);
 
        nbOutChannels =
            applicationProperties.getUserSettings()->getBoolValue("disableOutput") ?
@@ -114,7 +131,7 @@ public:
                                             JUCEApplicationBase::quit();
                                             return;
                                         }
-                                         deviceOpenError = audioDeviceManager.initialise (2, nbOutChannels, nullptr, true, {}, nullptr);
+                                         deviceOpenError = audioDeviceManager.initialise (recorder.getNumInputChannelsNeeded(), nbOutChannels, nullptr, true, {}, nullptr);
                                      });
        #endif
 
@@ -123,7 +140,7 @@ public:
         if (deviceOpenError.isNotEmpty())
         {
             // retry without output
-            deviceOpenError = audioDeviceManager.initialise(2, 0, nullptr, true, {}, nullptr);
+            deviceOpenError = audioDeviceManager.initialise(recorder.getNumInputChannelsNeeded(), 0, nullptr, true, {}, nullptr);
 
             if (deviceOpenError.isNotEmpty())
             {
@@ -139,12 +156,14 @@ public:
             }
         }
 
+        recorder.addListener(this);
         audioDeviceManager.addAudioCallback (&recorder);
         startRecording();
     }
 
     ~AudioSplitRecorder() override
     {
+        recorder.removeListener(this);
         audioDeviceManager.removeAudioCallback (&recorder);
     }
 
@@ -185,6 +204,16 @@ public:
         props->setValue("trim", true);
         props->setValue("removeChunks", true);
         props->setValue("chunkMaxSize", 10);
+        props->setValue("spillBufferLength", 30);
+        props->setValue("loudnessNormalization", false);
+        props->setValue("loudnessTarget", PostRecordJob::defaultLoudnessTarget);
+        props->setValue("seekPointInterval", ParallelFlacWriter::defaultSeekPointInterval);
+        props->setValue("channelGroups", "");
+        props->setValue("postRecordWorkers", 2);
+        props->setValue("postRecordQueueLength", 32);
+        props->setValue("postRecordJobsPerDisk", 1);
+        props->setValue("postRecordNewestFirst", false);
+        props->setValue("postRecordBlockBytes", AudioFileProcessor::defaultBlockBytes);
 
         props->save();
         props->reload();
@@ -216,7 +245,7 @@ private:
 
     // components
     RecordingThumbnail    recordingThumbnail;
-    AudioRecorder         recorder{ recordingThumbnail.getAudioThumbnail() };
+    ChannelGroupRecorder  recorder{ recordingThumbnail.getAudioThumbnail() };
     TextButton            muteButton;
     TextButton            clipLabel;
     TextButton            choseDestFolderButton;
@@ -225,6 +254,7 @@ private:
     ApplicationProperties applicationProperties;
     String                deviceOpenError;
     int                   nbOutChannels;
+    std::atomic<bool>     isClipping{ false };
 
     void startRecording()
     {
@@ -244,18 +274,21 @@ private:
         recorder.startRecording ();
 
         recordingThumbnail.repaint();
-
-        startTimer(10);
     }
 
-    void timerCallback() override
+    // on the recorder control thread, which splits the files on its own: only the display is left to us
+    void recorderEventReceived(const RecorderEvent& event) override
     {
-        if (recorder.shouldRestart)
+        if (event.type == RecorderEvent::Type::clipStarted || event.type == RecorderEvent::Type::clipEnded)
         {
-            recorder.startRecording(); // sets up the new file in advance        
-            recorder.shouldRestart = false;
+            isClipping = event.type == RecorderEvent::Type::clipStarted;
+            triggerAsyncUpdate();
         }
-        clipLabel.setVisible(recorder.clip);        
+    }
+
+    void handleAsyncUpdate() override
+    {
+        clipLabel.setVisible(isClipping);
     }
 
     void buttonClicked(Button* button) override
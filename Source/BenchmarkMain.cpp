@@ -0,0 +1,404 @@
+/*
+  ==============================================================================
+
+    Console entry point of CollectionBenchmarks: times the recording and
+    post-record kernels and writes the results to a JSON file, so that they
+    can be compared between releases.
+
+  ==============================================================================
+*/
+
+#include <iostream>
+#include <JuceHeader.h>
+#include "AudioFileNormalizer.h"
+#include "AudioFileTrimmer.h"
+#include "CircularBuffer.h"
+#include "ParallelFlacWriter.h"
+#include "PostRecordJob.h"
+#include "SilenceSearch.h"
+#include "SpillingWriter.h"
+#include "TuneStatistics.h"
+
+// Runs the benchmark cases and collects their results. Each case is repeated until it has run for
+// a minimum time; the throughput is computed from the fastest run, the least disturbed by the system.
+class BenchmarkRunner
+{
+public:
+    BenchmarkRunner(double minimumSeconds)
+        : minimumSeconds(minimumSeconds)
+    {
+    }
+
+    // prepare runs before each iteration and isn't timed, run is; samplesPerRun is per channel
+    void measure(const String &name, const NamedValueSet &parameters, int64 samplesPerRun,
+                 const std::function<void()> &prepare, const std::function<void()> &run)
+    {
+        int iterations = 0;
+        double totalSeconds = 0, minSeconds = std::numeric_limits<double>::max();
+
+        do
+        {
+            prepare();
+            const auto start = Time::getMillisecondCounterHiRes();
+            run();
+            const auto seconds = (Time::getMillisecondCounterHiRes() - start) / 1000.0;
+
+            totalSeconds += seconds;
+            minSeconds = jmin(minSeconds, seconds);
+            ++iterations;
+        } while (totalSeconds < minimumSeconds);
+
+        auto *result = new DynamicObject();
+        result->setProperty("name", name);
+        auto *parameterObject = new DynamicObject();
+        for (auto &parameter : parameters)
+        {
+            parameterObject->setProperty(parameter.name, parameter.value);
+        }
+        result->setProperty("parameters", var(parameterObject));
+        result->setProperty("iterations", iterations);
+        result->setProperty("meanSeconds", totalSeconds / iterations);
+        result->setProperty("minSeconds", minSeconds);
+        result->setProperty("samplesPerSecond", minSeconds > 0 ? (double)samplesPerRun / minSeconds : 0.0);
+        results.add(var(result));
+
+        std::cout << name << " " << JSON::toString(var(parameterObject), true) << ": "
+                  << String(minSeconds * 1000.0, 3) << " ms, "
+                  << String(minSeconds > 0 ? (double)samplesPerRun / minSeconds / 1.0e6 : 0.0, 1) << " Msamples/s" << std::endl;
+    }
+
+    bool writeTo(const File &file) const
+    {
+        auto *root = new DynamicObject();
+        root->setProperty("application", ProjectInfo::projectName);
+        root->setProperty("version", ProjectInfo::versionString);
+        root->setProperty("juceVersion", SystemStats::getJUCEVersion());
+        root->setProperty("date", Time::getCurrentTime().toISO8601(true));
+        root->setProperty("os", SystemStats::getOperatingSystemName());
+        root->setProperty("cpu", SystemStats::getCpuModel());
+        root->setProperty("numCpus", SystemStats::getNumCpus());
+        root->setProperty("results", results);
+        return file.replaceWithText(JSON::toString(var(root)));
+    }
+
+private:
+    double minimumSeconds;
+    Array<var> results;
+};
+
+static const double sampleRate = 48000;
+
+// a tune: silence, a noisy tone, silence
+static void fillSignal(AudioBuffer<float> &buffer, int64 startSample, int64 numSamples, int64 silenceLength, Random &random)
+{
+    for (int i = 0; i < buffer.getNumSamples(); i++)
+    {
+        const int64 sample = startSample + i;
+        const bool isSound = sample >= silenceLength && sample < numSamples - silenceLength;
+        const float tone = isSound ? 0.5f * (float)std::sin(MathConstants<double>::twoPi * 440.0 * (double)sample / sampleRate) : 0.0f;
+        for (int channel = 0; channel < buffer.getNumChannels(); channel++)
+        {
+            buffer.setSample(channel, i, tone + 0.001f * (random.nextFloat() - 0.5f));
+        }
+    }
+}
+
+// writes a synthetic tune and returns the statistics the recorder would have gathered for it
+static TuneStatistics createTuneFile(const File &file, AudioFormat &format, int numChannels, int64 numSamples,
+                                     int bitDepth, int qualityOptionIndex, float threshold)
+{
+    file.deleteFile();
+    TuneStatisticsAccumulator statistics;
+    statistics.reset(sampleRate, threshold);
+
+    if (auto fileStream = std::unique_ptr<FileOutputStream>(file.createOutputStream()))
+    {
+        std::unique_ptr<AudioFormatWriter> writer(format.createWriterFor(fileStream.get(), sampleRate, (unsigned int)numChannels,
+                                                                         bitDepth, {}, qualityOptionIndex));
+        if (writer != nullptr)
+        {
+            fileStream.release(); // (passes responsibility for deleting the stream to the writer object that is now using it)
+            Random random(1);
+            AudioBuffer<float> buffer(numChannels, 4096);
+            for (int64 position = 0; position < numSamples; position += buffer.getNumSamples())
+            {
+                fillSignal(buffer, position, numSamples, (int64)sampleRate, random);
+                const int length = (int)jmin((int64)buffer.getNumSamples(), numSamples - position);
+                writer->writeFromFloatArrays(buffer.getArrayOfReadPointers(), numChannels, length);
+                statistics.addBlock(buffer.getArrayOfReadPointers(), numChannels, length);
+            }
+        }
+    }
+    return statistics.getStatistics();
+}
+
+static void benchmarkCircularBuffer(BenchmarkRunner &runner)
+{
+    const int blockSize = 512;
+    const int numBlocks = 2000;
+
+    for (double windowSeconds : { 1.0, 2.0, 5.0 })
+    {
+        for (int numChannels : { 1, 2, 8 })
+        {
+            const int windowSize = (int)(windowSeconds * sampleRate);
+            CircularBuffer<float> circularBuffer(numChannels, windowSize);
+            AudioBuffer<float> block(numChannels, blockSize);
+            Random random(1);
+            fillSignal(block, (int64)sampleRate, 4 * (int64)sampleRate, 0, random);
+
+            NamedValueSet parameters;
+            parameters.set("windowSize", windowSize);
+            parameters.set("numChannels", numChannels);
+            parameters.set("blockSize", blockSize);
+
+            runner.measure("CircularBuffer::push", parameters, (int64)numBlocks * blockSize, [] {}, [&] {
+                for (int i = 0; i < numBlocks; i++)
+                {
+                    circularBuffer.push(block);
+                }
+            });
+
+            // once per audio callback in the recorder
+            volatile float level = 0;
+            runner.measure("CircularBuffer::getRMSLevel", parameters, (int64)numBlocks * blockSize, [] {}, [&] {
+                for (int i = 0; i < numBlocks; i++)
+                {
+                    level = circularBuffer.getRMSLevel();
+                }
+            });
+        }
+    }
+}
+
+// the leading silence search of AudioFileTrimer, against the former per sample getMagnitude() loop
+static void benchmarkSilenceSearch(BenchmarkRunner &runner)
+{
+    const int numSamples = 1 << 16;
+
+    for (int numChannels : { 2, 8 })
+    {
+        AudioBuffer<float> block(numChannels, numSamples);
+        Random random(1);
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            for (int i = 0; i < numSamples; i++)
+            {
+                block.setSample(channel, i, 0.001f * (random.nextFloat() - 0.5f)); // silent up to the last sample
+            }
+        }
+        block.setSample(0, numSamples - 1, 0.5f);
+
+        NamedValueSet parameters;
+        parameters.set("numChannels", numChannels);
+        parameters.set("blockSize", numSamples);
+
+        volatile int found = 0;
+        runner.measure("SilenceSearch::findFirstSound", parameters, numSamples, [] {}, [&] {
+            found = SilenceSearch::findFirstSound(block.getArrayOfReadPointers(), numChannels, numSamples, 0.01f);
+        });
+        runner.measure("getMagnitude per sample", parameters, numSamples, [] {}, [&] {
+            int i = 0;
+            while (i < numSamples && block.getMagnitude(i, 1) < 0.01f)
+            {
+                ++i;
+            }
+            found = i;
+        });
+    }
+}
+
+// what AudioRecorder::writeMemoryIntoFile does when a tune starts: the whole window goes into the
+// FIFO of the spilling writer; the time includes the background thread writing it to the disk
+static void benchmarkWriteMemory(BenchmarkRunner &runner, const File &folder)
+{
+    WavAudioFormat wavFormat;
+    SpillBufferPool bufferPool;
+    TimeSliceThread backgroundThread("Benchmark writer thread");
+    backgroundThread.startThread();
+
+    for (int numChannels : { 2, 8 })
+    {
+        const int windowSize = (int)(2.0 * sampleRate);
+        CircularBuffer<float> circularBuffer(numChannels, windowSize);
+        AudioBuffer<float> block(numChannels, 1000);
+        Random random(1);
+        for (int i = 0; i < 150; i++)
+        {
+            fillSignal(block, (int64)i * block.getNumSamples(), 1000000, 0, random);
+            circularBuffer.push(block);
+        }
+
+        const File file(folder.getChildFile("memory.wav"));
+        std::unique_ptr<SpillingWriter> spillingWriter;
+        auto prepare = [&] {
+            spillingWriter.reset();
+            file.deleteFile();
+            if (auto fileStream = std::unique_ptr<FileOutputStream>(file.createOutputStream()))
+            {
+                if (auto writer = wavFormat.createWriterFor(fileStream.get(), sampleRate, (unsigned int)numChannels, 24, {}, 0))
+                {
+                    fileStream.release();
+                    spillingWriter.reset(new SpillingWriter(writer, backgroundThread, bufferPool, windowSize + 1));
+                }
+            }
+        };
+
+        NamedValueSet parameters;
+        parameters.set("windowSize", windowSize);
+        parameters.set("numChannels", numChannels);
+
+        runner.measure("writeMemoryIntoFile", parameters, windowSize, prepare, [&] {
+            CircularBuffer<float>::Segment oldest, newest;
+            circularBuffer.getSegments(oldest, newest);
+            spillingWriter->write(oldest.channels, oldest.numSamples);
+            spillingWriter->write(newest.channels, newest.numSamples);
+            spillingWriter.reset(); // flushes
+        });
+        file.deleteFile();
+    }
+    backgroundThread.stopThread(1000);
+}
+
+static void benchmarkPostRecord(BenchmarkRunner &runner, const File &folder, double tuneSeconds)
+{
+    AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+    const float threshold = 0.01f;
+    const int64 numSamples = (int64)(tuneSeconds * sampleRate);
+
+    for (auto extension : { ".wav", ".flac" })
+    {
+        auto *format = formatManager.findFormatForFileExtension(extension);
+        const File file(folder.getChildFile(String("Tune") + extension));
+        TuneStatistics statistics;
+        auto prepare = [&] { statistics = createTuneFile(file, *format, 2, numSamples, 24, 3, threshold); };
+
+        NamedValueSet parameters;
+        parameters.set("format", String(extension).substring(1));
+        parameters.set("numChannels", 2);
+        parameters.set("bitDepth", 24);
+        parameters.set("seconds", tuneSeconds);
+
+        runner.measure("AudioFileNormalizer", parameters, numSamples, prepare, [&] {
+            AudioFileNormalizer normalizer(file);
+            normalizer.process();
+        });
+        runner.measure("AudioFileTrimer", parameters, numSamples, prepare, [&] {
+            AudioFileTrimer trimer(file, threshold);
+            trimer.process();
+        });
+        // the single pass of the treatment, by blocks of 64 kB to 4 MB
+        for (int blockBytes : { 1 << 16, AudioFileProcessor::defaultBlockBytes, 1 << 22 })
+        {
+            AudioFileProcessor::SharedResources resources;
+            resources.blockBytes = blockBytes;
+            auto blockParameters = parameters;
+            blockParameters.set("blockBytes", blockBytes);
+            runner.measure("AudioFileProcessingChain", blockParameters, numSamples, prepare, [&] {
+                AudioFileProcessingChain chain(file, &resources);
+                chain.addStage(new GainStage(0.5f));
+                chain.process();
+            });
+        }
+        runner.measure("PostRecordJob (without statistics)", parameters, numSamples, prepare, [&] {
+            PostRecordJob job(nullptr, file, TuneStatistics(), true, true, true, &formatManager, threshold, 10);
+            job.run(nullptr);
+        });
+        runner.measure("PostRecordJob", parameters, numSamples, prepare, [&] {
+            PostRecordJob job(nullptr, file, statistics, true, true, true, &formatManager, threshold, 10);
+            job.run(nullptr);
+        });
+        file.deleteFile();
+    }
+}
+
+static void benchmarkFlacEncoder(BenchmarkRunner &runner, const File &folder, double tuneSeconds)
+{
+    FlacAudioFormat flacFormat;
+    const File file(folder.getChildFile("encoded.flac"));
+    const int64 numSamples = (int64)(tuneSeconds * sampleRate);
+
+    for (int quality = 0; quality < flacFormat.getQualityOptions().size(); quality++)
+    {
+        for (int bitDepth : { 16, 24 })
+        {
+            NamedValueSet parameters;
+            parameters.set("quality", flacFormat.getQualityOptions()[quality]);
+            parameters.set("numChannels", 2);
+            parameters.set("bitDepth", bitDepth);
+            parameters.set("seconds", tuneSeconds);
+
+            runner.measure("FLAC encoder", parameters, numSamples, [] {}, [&] {
+                createTuneFile(file, flacFormat, 2, numSamples, bitDepth, quality, 0.01f);
+            });
+        }
+    }
+    file.deleteFile();
+}
+
+// the encoder of the recorder and of the post-record treatments, against the one of JUCE
+static void benchmarkParallelFlacEncoder(BenchmarkRunner &runner, const File &folder, double tuneSeconds)
+{
+    FlacAudioFormat flacFormat;
+    ParallelFlacAudioFormat parallelFlacFormat;
+    const File file(folder.getChildFile("encoded.flac"));
+    const int64 numSamples = (int64)(tuneSeconds * sampleRate);
+
+    for (int numChannels : { 2, 8 })
+    {
+        NamedValueSet parameters;
+        parameters.set("quality", flacFormat.getQualityOptions()[3]);
+        parameters.set("numChannels", numChannels);
+        parameters.set("bitDepth", 24);
+        parameters.set("seconds", tuneSeconds);
+
+        runner.measure("FLAC encoder", parameters, numSamples, [] {}, [&] {
+            createTuneFile(file, flacFormat, numChannels, numSamples, 24, 3, 0.01f);
+        });
+        runner.measure("ParallelFlacWriter", parameters, numSamples, [] {}, [&] {
+            createTuneFile(file, parallelFlacFormat, numChannels, numSamples, 24, 3, 0.01f);
+        });
+    }
+    file.deleteFile();
+}
+
+int main(int argc, char *argv[])
+{
+    ArgumentList args(argc, argv);
+
+    if (args.containsOption("--help|-h"))
+    {
+        std::cout << "Usage: CollectionBenchmarks [options]" << std::endl
+                  << "  --output=<file>    JSON results (default: benchmark-results.json)" << std::endl
+                  << "  --quick            shorter runs and files, for a smoke test" << std::endl;
+        return 0;
+    }
+
+    const bool quick = args.containsOption("--quick");
+    const File output = args.containsOption("--output") ? args.getFileForOption("--output")
+                                                        : File::getCurrentWorkingDirectory().getChildFile("benchmark-results.json");
+
+    const File folder(File::createTempFile("benchmark"));
+    folder.createDirectory();
+
+    BenchmarkRunner runner(quick ? 0.05 : 1.0);
+    const double tuneSeconds = quick ? 5.0 : 60.0;
+
+    benchmarkCircularBuffer(runner);
+    benchmarkSilenceSearch(runner);
+    benchmarkWriteMemory(runner, folder);
+    benchmarkPostRecord(runner, folder, tuneSeconds);
+    benchmarkFlacEncoder(runner, folder, tuneSeconds);
+    benchmarkParallelFlacEncoder(runner, folder, tuneSeconds);
+
+    folder.deleteRecursively();
+
+    if (!runner.writeTo(output))
+    {
+        std::cerr << "Can't write " << output.getFullPathName() << std::endl;
+        return 1;
+    }
+    std::cout << "Results written to " << output.getFullPathName() << std::endl;
+    return 0;
+}
\ No newline at end of file
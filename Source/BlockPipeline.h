@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <JuceHeader.h>
+
+// Runs the read, process and write stages of a pass over a file each on its own thread, so that decoding,
+// the DSP and encoding overlap: the reader fills block n + 2 while the processing handles n + 1 and the
+// writer encodes n. The blocks go round a ring of slots; a stage waits for the one before it, and the
+// reader waits when it is a whole ring ahead of the writer, which bounds the memory.
+//
+// The write stage runs on the calling thread, the other ones on threads started for the pass. Each stage
+// returns false to stop the pass, which then returns false.
+class BlockPipeline
+{
+public:
+    using Stage = std::function<bool(AudioSampleBuffer &block, int64 blockIndex)>;
+
+    // without a process stage, the writer takes the blocks straight from the reader
+    static bool run(AudioSampleBuffer *slots, int numSlots, int64 numBlocks, Stage read, Stage process, Stage write)
+    {
+        jassert(numSlots >= 2);
+
+        // nothing to overlap
+        if (numBlocks < 2)
+        {
+            for (int64 i = 0; i < numBlocks; i++)
+            {
+                if (!read(slots[0], i) || (process != nullptr && !process(slots[0], i)) || !write(slots[0], i))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        BlockPipeline pipeline(slots, numSlots, numBlocks);
+        StageThread reader("Treatment reader", [&] { pipeline.runReader(read); });
+        std::unique_ptr<StageThread> processor;
+
+        reader.startThread();
+        if (process != nullptr)
+        {
+            processor.reset(new StageThread("Treatment processor", [&] { pipeline.runProcessor(process); }));
+            processor->startThread();
+        }
+        pipeline.runWriter(write, process != nullptr ? pipeline.numProcessed : pipeline.numRead,
+                           process != nullptr ? pipeline.blockProcessed : pipeline.blockRead);
+
+        reader.stopThread(-1);
+        if (processor != nullptr)
+        {
+            processor->stopThread(-1);
+        }
+        return !pipeline.failed;
+    }
+
+private:
+    class StageThread : public Thread
+    {
+    public:
+        StageThread(const String &name, std::function<void()> stage)
+            : Thread(name),
+              stage(std::move(stage))
+        {
+        }
+
+        void run() override
+        {
+            stage();
+        }
+
+    private:
+        std::function<void()> stage;
+    };
+
+    AudioSampleBuffer *const slots;
+    const int numSlots;
+    const int64 numBlocks;
+
+    // each counter is only written by its stage; each event only waited for by the next stage
+    std::atomic<int64> numRead{0}, numProcessed{0}, numWritten{0};
+    std::atomic<bool> failed{false};
+    WaitableEvent blockRead, blockProcessed, blockWritten;
+
+    BlockPipeline(AudioSampleBuffer *slots, int numSlots, int64 numBlocks)
+        : slots(slots),
+          numSlots(numSlots),
+          numBlocks(numBlocks)
+    {
+    }
+
+    // waits until the condition holds, false when the pass failed meanwhile
+    bool waitFor(WaitableEvent &event, const std::function<bool()> &condition)
+    {
+        while (!failed && !condition())
+        {
+            event.wait(-1);
+        }
+        return !failed;
+    }
+
+    void fail()
+    {
+        failed = true;
+        blockRead.signal();
+        blockProcessed.signal();
+        blockWritten.signal();
+    }
+
+    void runReader(const Stage &read)
+    {
+        for (int64 i = 0; i < numBlocks; i++)
+        {
+            if (!waitFor(blockWritten, [&] { return i - numWritten.load() < numSlots; }))
+            {
+                return;
+            }
+            if (!read(slots[i % numSlots], i))
+            {
+                fail();
+                return;
+            }
+            numRead = i + 1;
+            blockRead.signal();
+        }
+    }
+
+    void runProcessor(const Stage &process)
+    {
+        for (int64 i = 0; i < numBlocks; i++)
+        {
+            if (!waitFor(blockRead, [&] { return numRead.load() > i; }))
+            {
+                return;
+            }
+            if (!process(slots[i % numSlots], i))
+            {
+                fail();
+                return;
+            }
+            numProcessed = i + 1;
+            blockProcessed.signal();
+        }
+    }
+
+    void runWriter(const Stage &write, const std::atomic<int64> &numReady, WaitableEvent &blockReady)
+    {
+        for (int64 i = 0; i < numBlocks; i++)
+        {
+            if (!waitFor(blockReady, [&] { return numReady.load() > i; }))
+            {
+                return;
+            }
+            if (!write(slots[i % numSlots], i))
+            {
+                fail();
+                return;
+            }
+            numWritten = i + 1;
+            blockWritten.signal();
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BlockPipeline)
+};
\ No newline at end of file
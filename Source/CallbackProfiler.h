@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <JuceHeader.h>
+
+// Times the phases of the audio callback against the buffer deadline, without locks or allocations:
+// the audio thread only increments atomic counters, any other thread can take a snapshot of them.
+//
+// Each phase has a histogram of its durations as a fraction of the deadline, in powers of two from
+// 1/2^20 of the deadline up to twice the deadline, plus an overflow bucket. The whole callback also
+// counts near-misses (more than 80 % of the deadline) and overruns (more than the deadline).
+class CallbackProfiler
+{
+public:
+    enum Phase
+    {
+        ringPush = 0,
+        rmsLevel,
+        preRollFlush,
+        writerWrite,
+        thumbnailPush,
+        monitoringCopy,
+        wholeCallback,
+        numPhases
+    };
+
+    static constexpr int numBuckets = 23;
+
+    CallbackProfiler()
+    {
+        reset();
+    }
+
+    struct PhaseSnapshot
+    {
+        uint32 buckets[numBuckets] = {};
+        uint32 count = 0;
+        double meanFraction = 0; // of the deadline
+        double maxFraction = 0;
+    };
+
+    struct Snapshot
+    {
+        double deadlineSeconds = 0;
+        uint32 numNearMisses = 0;
+        uint32 numOverruns = 0;
+        PhaseSnapshot phases[numPhases];
+    };
+
+    // times a phase from its construction to its destruction
+    class ScopedPhase
+    {
+    public:
+        ScopedPhase(CallbackProfiler &profiler, Phase phase) noexcept
+            : profiler(profiler),
+              phase(phase),
+              start(Time::getHighResolutionTicks())
+        {
+        }
+
+        ~ScopedPhase() noexcept
+        {
+            profiler.add(phase, Time::getHighResolutionTicks() - start);
+        }
+
+    private:
+        CallbackProfiler &profiler;
+        const Phase phase;
+        const int64 start;
+    };
+
+    // not real-time safe, call it when the device (re)starts
+    void prepare(int bufferSize, double sampleRate)
+    {
+        deadlineTicks = jmax((int64)1, (int64)(bufferSize / sampleRate * (double)Time::getHighResolutionTicksPerSecond()));
+        reset();
+    }
+
+    void reset() noexcept
+    {
+        for (auto &histogram : histograms)
+        {
+            for (auto &bucket : histogram.buckets)
+                bucket.store(0, std::memory_order_relaxed);
+            histogram.count.store(0, std::memory_order_relaxed);
+            histogram.totalTicks.store(0, std::memory_order_relaxed);
+            histogram.maxTicks.store(0, std::memory_order_relaxed);
+        }
+        numNearMisses.store(0, std::memory_order_relaxed);
+        numOverruns.store(0, std::memory_order_relaxed);
+    }
+
+    // audio thread
+    void add(Phase phase, int64 ticks) noexcept
+    {
+        auto &histogram = histograms[phase];
+        const int64 deadline = deadlineTicks.load(std::memory_order_relaxed);
+
+        histogram.buckets[getBucket(ticks, deadline)].fetch_add(1, std::memory_order_relaxed);
+        histogram.count.fetch_add(1, std::memory_order_relaxed);
+        histogram.totalTicks.fetch_add(ticks, std::memory_order_relaxed);
+        if (ticks > histogram.maxTicks.load(std::memory_order_relaxed))
+        {
+            histogram.maxTicks.store(ticks, std::memory_order_relaxed); // only the audio thread writes it
+        }
+
+        if (phase == wholeCallback)
+        {
+            if (ticks > deadline)
+                numOverruns.fetch_add(1, std::memory_order_relaxed);
+            else if (ticks * 5 > deadline * 4)
+                numNearMisses.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // any thread; the counters are read one by one, a snapshot taken while the audio runs can be off by a callback
+    Snapshot getSnapshot() const noexcept
+    {
+        Snapshot snapshot;
+        const int64 deadline = deadlineTicks.load(std::memory_order_relaxed);
+        snapshot.deadlineSeconds = Time::highResolutionTicksToSeconds(deadline);
+        snapshot.numNearMisses = numNearMisses.load(std::memory_order_relaxed);
+        snapshot.numOverruns = numOverruns.load(std::memory_order_relaxed);
+
+        for (int phase = 0; phase < numPhases; phase++)
+        {
+            auto &histogram = histograms[phase];
+            auto &phaseSnapshot = snapshot.phases[phase];
+            for (int i = 0; i < numBuckets; i++)
+                phaseSnapshot.buckets[i] = histogram.buckets[i].load(std::memory_order_relaxed);
+            phaseSnapshot.count = histogram.count.load(std::memory_order_relaxed);
+            if (phaseSnapshot.count > 0)
+                phaseSnapshot.meanFraction = (double)histogram.totalTicks.load(std::memory_order_relaxed) / (double)phaseSnapshot.count / (double)deadline;
+            phaseSnapshot.maxFraction = (double)histogram.maxTicks.load(std::memory_order_relaxed) / (double)deadline;
+        }
+        return snapshot;
+    }
+
+    static const char *getPhaseName(int phase) noexcept
+    {
+        static const char *const names[numPhases] = {"ring push", "RMS level", "pre-roll flush", "writer write",
+                                                      "thumbnail push", "monitoring copy", "whole callback"};
+        return names[phase];
+    }
+
+    // the durations counted by a bucket are up to this fraction of the deadline (the last one has no limit)
+    static double getBucketUpperFraction(int bucket) noexcept
+    {
+        return std::ldexp(1.0, bucket - (numBuckets - 3));
+    }
+
+private:
+    struct Histogram
+    {
+        std::atomic<uint32> buckets[numBuckets];
+        std::atomic<uint32> count{0};
+        std::atomic<int64> totalTicks{0};
+        std::atomic<int64> maxTicks{0};
+    };
+
+    Histogram histograms[numPhases];
+    std::atomic<int64> deadlineTicks{1};
+    std::atomic<uint32> numNearMisses{0};
+    std::atomic<uint32> numOverruns{0};
+
+    static int getBucket(int64 ticks, int64 deadline) noexcept
+    {
+        // bucket 0 is below deadline / 2^20, each next bucket doubles
+        const int64 scaled = ticks * (1 << (numBuckets - 3)) / deadline;
+        int bucket = 0;
+        for (int64 value = scaled; value > 0 && bucket < numBuckets - 1; value >>= 1)
+            ++bucket;
+        return bucket;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CallbackProfiler)
+};
\ No newline at end of file
@@ -0,0 +1,259 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioRecorder.h"
+
+// Several decks digitised through one multichannel interface: the input channels are cut into groups
+// (1-2, 3-4...), each one recorded by its own AudioRecorder, with its own silence detection, pre-roll,
+// files and folder. The audio callback only hands each recorder its channels; the disk writing, the
+// encoding, the file rotation and the treatments of each group run on threads of their own, so the
+// groups spread over the cores while the callback stays as short as with a single recorder.
+// Without groups, a single recorder gets all the channels.
+class ChannelGroupRecorder : public AudioIODeviceCallback
+{
+public:
+    // the thumbnail shows the first group
+    ChannelGroupRecorder(AudioThumbnail &thumbnailToUpdate)
+        : thumbnail(thumbnailToUpdate)
+    {
+        thumbnailFormatManager.registerBasicFormats();
+        setChannelGroups({});
+    }
+
+    // "1-2, 3-4, 5" gives the channel ranges from 0; nothing when the text isn't a list of groups
+    static Array<Range<int>> parseChannelGroups(const String &text)
+    {
+        Array<Range<int>> groups;
+        for (auto &token : StringArray::fromTokens(text, ",", {}))
+        {
+            if (token.trim().isEmpty())
+            {
+                continue;
+            }
+
+            auto bounds = StringArray::fromTokens(token.trim(), "-", {});
+            const int first = bounds[0].getIntValue();
+            const int last = bounds.size() > 1 ? bounds[1].getIntValue() : first;
+            if (first < 1 || last < first)
+            {
+                return {};
+            }
+            groups.add(Range<int>(first - 1, last));
+        }
+        return groups;
+    }
+
+    // before the device starts and the listeners are added: the recorders of the former groups are closed
+    void setChannelGroups(const Array<Range<int>> &newGroups)
+    {
+        recorders.clear();
+        groupThumbnails.clear();
+        groups = newGroups;
+
+        for (int i = 0; i < jmax(1, groups.size()); i++)
+        {
+            auto *groupThumbnail = i == 0 ? &thumbnail : groupThumbnails.add(new AudioThumbnail(512, thumbnailFormatManager, thumbnailCache));
+            recorders.add(new AudioRecorder(*groupThumbnail));
+        }
+    }
+
+    int getNumInputChannelsNeeded() const
+    {
+        int numChannels = 2;
+        for (auto &group : groups)
+        {
+            numChannels = jmax(numChannels, group.getEnd());
+        }
+        return numChannels;
+    }
+
+    void initialize(String folder,
+                    AudioRecorder::SupportedAudioFormat format,
+                    float rmsThres,
+                    float silenceLen,
+                    bool normalize,
+                    bool trim,
+                    bool removeChunks,
+                    int chunkMaxSize)
+    {
+        currentFolder = folder;
+        for (int i = 0; i < recorders.size(); i++)
+        {
+            recorders[i]->initialize(getGroupFolder(i), format, rmsThres, silenceLen, normalize, trim, removeChunks, chunkMaxSize);
+        }
+    }
+
+    void setSpillBufferLength(float seconds)
+    {
+        for (auto *recorder : recorders)
+            recorder->setSpillBufferLength(seconds);
+    }
+
+    void setLoudnessNormalization(bool enabled, float targetLoudness)
+    {
+        for (auto *recorder : recorders)
+            recorder->setLoudnessNormalization(enabled, targetLoudness);
+    }
+
+    void setSeekPointInterval(double seconds)
+    {
+        for (auto *recorder : recorders)
+            recorder->setSeekPointInterval(seconds);
+    }
+
+    // the treatments of all the groups share the workers and the disk limits
+    void setPostRecordOptions(const PostRecordScheduler::Options &options)
+    {
+        recorders.getFirst()->setPostRecordOptions(options);
+    }
+
+    File getCurrentFolder()
+    {
+        return currentFolder;
+    }
+
+    void setCurrentFolder(File folder)
+    {
+        currentFolder = folder.getFullPathName();
+        for (int i = 0; i < recorders.size(); i++)
+        {
+            recorders[i]->setCurrentFolder(getGroupFolder(i));
+        }
+    }
+
+    void setCurrentFormat(AudioRecorder::SupportedAudioFormat format)
+    {
+        for (auto *recorder : recorders)
+            recorder->setCurrentFormat(format);
+    }
+
+    // only the first group is sent to the output
+    void mute(bool isMuted)
+    {
+        recorders.getFirst()->mute(isMuted);
+    }
+
+    void startRecording()
+    {
+        for (auto *recorder : recorders)
+            recorder->startRecording();
+    }
+
+    // the events of all the groups
+    void addListener(AudioRecorder::Listener *listener)
+    {
+        for (auto *recorder : recorders)
+            recorder->addListener(listener);
+    }
+
+    void removeListener(AudioRecorder::Listener *listener)
+    {
+        for (auto *recorder : recorders)
+            recorder->removeListener(listener);
+    }
+
+    //==============================================================================
+    void audioDeviceAboutToStart(AudioIODevice *device) override
+    {
+        const auto activeChannels = device->getActiveInputChannels();
+        groupChannels.clearQuick();
+        for (int i = 0; i < recorders.size(); i++)
+        {
+            const auto channels = getGroupChannels(i, activeChannels);
+            groupChannels.add(channels);
+            if (channels.isEmpty())
+            {
+                // left unprepared, its recorder creates no file (see AudioRecorder::startRecording)
+                Logger::writeToLog(File(getGroupFolder(i)).getFileName() + " isn't recorded: not all its input channels are active on the device");
+                recorders[i]->stop();
+                recorders[i]->audioDeviceStopped();
+                continue;
+            }
+            recorders[i]->prepareToRecord(channels.getLength(), device->getCurrentSampleRate(),
+                                          device->getCurrentBitDepth(), device->getCurrentBufferSizeSamples());
+        }
+    }
+
+    void audioDeviceStopped() override
+    {
+        for (auto *recorder : recorders)
+            recorder->audioDeviceStopped();
+    }
+
+    void audioDeviceIOCallback(const float **inputChannelData, int numInputChannels,
+                               float **outputChannelData, int numOutputChannels,
+                               int numSamples) override
+    {
+        for (int i = 0; i < recorders.size(); i++)
+        {
+            const auto channels = groupChannels[i];
+            if (channels.isEmpty() || channels.getEnd() > numInputChannels)
+            {
+                // a group without all its channels records nothing
+                if (i == 0)
+                {
+                    for (int j = 0; j < numOutputChannels; ++j)
+                        if (outputChannelData[j] != nullptr)
+                            FloatVectorOperations::clear(outputChannelData[j], numSamples);
+                }
+                continue;
+            }
+
+            // no copy: each recorder gets the pointers to its channels
+            recorders[i]->audioDeviceIOCallback(inputChannelData + channels.getStart(), channels.getLength(),
+                                                i == 0 ? outputChannelData : nullptr, i == 0 ? numOutputChannels : 0,
+                                                numSamples);
+        }
+    }
+
+private:
+    AudioThumbnail &thumbnail;
+    AudioFormatManager thumbnailFormatManager;
+    AudioThumbnailCache thumbnailCache{ 8 };
+    OwnedArray<AudioThumbnail> groupThumbnails; // of the groups after the first one, nobody draws them
+    OwnedArray<AudioRecorder> recorders;        // declared after the thumbnails they update
+    Array<Range<int>> groups;        // device channel numbers
+    Array<Range<int>> groupChannels; // in the channels the callback gets, set when the device starts
+    String currentFolder;
+
+    // The callback only gets the active input channels of the device, one after the other: a group is
+    // at the index of its first channel among the active ones. Empty when one of its channels is inactive.
+    Range<int> getGroupChannels(int group, const BigInteger &activeChannels) const
+    {
+        if (groups.isEmpty())
+        {
+            return Range<int>(0, activeChannels.countNumberOfSetBits());
+        }
+
+        const auto channels = groups[group];
+        int start = 0;
+        for (int channel = 0; channel < channels.getEnd(); channel++)
+        {
+            if (channel < channels.getStart())
+            {
+                start += activeChannels[channel] ? 1 : 0;
+            }
+            else if (!activeChannels[channel])
+            {
+                return {};
+            }
+        }
+        return Range<int>(start, start + channels.getLength());
+    }
+
+    // each group has its own sub folder, "Channels 3-4"
+    String getGroupFolder(int group) const
+    {
+        if (groups.isEmpty())
+        {
+            return currentFolder;
+        }
+
+        const auto channels = groups[group];
+        const String name = channels.getLength() == 1 ? "Channel " + String(channels.getStart() + 1)
+                                                      : "Channels " + String(channels.getStart() + 1) + "-" + String(channels.getEnd());
+        return File(currentFolder).getChildFile(name).getFullPathName();
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ChannelGroupRecorder)
+};
\ No newline at end of file
@@ -15,9 +15,19 @@ public :
 		isFull(false)
 	{
 		audiobuffer.clear();
+		squareSums.calloc((size_t)channels);
+		oldestSegmentChannels.calloc((size_t)channels);
+		newestSegmentChannels.calloc((size_t)channels);
 	}
 
-	void push(AudioBuffer<Type> bufferToAdd) noexcept
+	// a contiguous run of samples of the window, that can be read without copying it
+	struct Segment
+	{
+		const Type* const* channels = nullptr;
+		int numSamples = 0;
+	};
+
+	void push(const AudioBuffer<Type>& bufferToAdd) noexcept
 	{
 		jassert(bufferToAdd.getNumChannels() == audiobuffer.getNumChannels());
 		jassert(bufferToAdd.getNumSamples() <= audiobuffer.getNumSamples());
@@ -29,8 +39,10 @@ public :
 			{
 				int nbSamplesToWrite = audiobuffer.getNumSamples() - origin;
 				//first 
+				updateSquareSum(i, origin, bufferToAdd.getReadPointer(i), nbSamplesToWrite);
 				audiobuffer.copyFrom(i, origin, bufferToAdd.getReadPointer(i), nbSamplesToWrite);
 				// then
+				updateSquareSum(i, 0, bufferToAdd.getReadPointer(i, nbSamplesToWrite), bufferToAdd.getNumSamples() - nbSamplesToWrite);
 				audiobuffer.copyFrom(i, 0, bufferToAdd.getReadPointer(i, nbSamplesToWrite), bufferToAdd.getNumSamples() - nbSamplesToWrite);
 			}
 		}
@@ -38,6 +50,7 @@ public :
 		{
 			for (int i = 0; i < audiobuffer.getNumChannels(); i++)
 			{
+				updateSquareSum(i, origin, bufferToAdd.getReadPointer(i), bufferToAdd.getNumSamples());
 				audiobuffer.copyFrom(i, origin, bufferToAdd.getReadPointer(i), bufferToAdd.getNumSamples());
 			}
 		}
@@ -49,6 +62,7 @@ public :
 	{
 		jassert(channel < audiobuffer.getNumChannels());
 
+		updateSquareSum(channel, origin, &valueToAdd, 1);
 		audiobuffer.setSample(channel, origin, valueToAdd);
 		increaseOrigin(1);
 	}
@@ -61,7 +75,21 @@ public :
 		return audiobuffer.getSample(channel, (origin + index) % size);
 	}
 
-	const AudioBuffer<Type> getRaw() const noexcept
+	// the whole window, oldest sample first, as the two runs [origin, size) and [0, origin) of the buffer
+	void getSegments(Segment& oldest, Segment& newest) noexcept
+	{
+		for (int i = 0; i < audiobuffer.getNumChannels(); i++)
+		{
+			oldestSegmentChannels[i] = audiobuffer.getReadPointer(i, origin);
+			newestSegmentChannels[i] = audiobuffer.getReadPointer(i);
+		}
+		oldest.channels = oldestSegmentChannels;
+		oldest.numSamples = size - origin;
+		newest.channels = newestSegmentChannels;
+		newest.numSamples = origin;
+	}
+
+	const AudioBuffer<Type>& getRaw() const noexcept
 	{
 		return audiobuffer;
 	}
@@ -75,17 +103,43 @@ public :
 	{
 		jassert(index >= 0 && index < size);
 
+		updateSquareSum(channel, (origin + index) % size, &newValue, 1);
 		audiobuffer.setSample(channel, (origin + index) % size, newValue);
 	}
 
-	Type getRMSLevel()
+	// RMS of the whole window for one channel, O(1) thanks to the running sum of squares
+	Type getRMSLevel(int channel) const noexcept
+	{
+		jassert(channel < audiobuffer.getNumChannels());
+
+		return toRMSLevel(squareSums[channel], size);
+	}
+
+	// mean of the per channel RMS levels of the whole window
+	Type getRMSLevel() const noexcept
+	{
+		return toMeanRMSLevel(squareSums, audiobuffer.getNumChannels(), size);
+	}
+
+	// the level computations, public so that an analysis keeping its own sums gets the very same values
+	static int64 toFixedPointSquare(Type sample) noexcept
+	{
+		return (int64)(jmin((double)sample * (double)sample, maxSquare) * fixedPointScale + 0.5);
+	}
+
+	static Type toRMSLevel(int64 squareSum, int windowSize) noexcept
+	{
+		return (Type)std::sqrt((double)squareSum / (fixedPointScale * windowSize));
+	}
+
+	static Type toMeanRMSLevel(const int64* channelSquareSums, int numChannels, int windowSize) noexcept
 	{
 		Type mean = 0;
-		for (int i = 0; i < audiobuffer.getNumChannels(); i++) 
+		for (int i = 0; i < numChannels; i++) 
 		{
-			mean += audiobuffer.getRMSLevel(0, 0, size);
+			mean += toRMSLevel(channelSquareSums[i], windowSize);
 		}
-		return mean / audiobuffer.getNumChannels();
+		return mean / numChannels;
 	}
 
 	bool isBufferFull() 
@@ -104,15 +158,35 @@ public :
 	}
 
 private :
+	// squares are accumulated in fixed point so that adding the incoming samples and removing
+	// the outgoing ones is exact: the running sum never drifts, whatever the session length
+	static constexpr double fixedPointScale = 4294967296.0; // 2^32
+	static constexpr double maxSquare = 4.0; // keeps size * maxSquare * fixedPointScale in an int64
+
 	AudioBuffer<Type> audiobuffer;
+	HeapBlock<int64> squareSums;
+	HeapBlock<const Type*> oldestSegmentChannels, newestSegmentChannels;
 	int origin;
 	int size;
 	bool isFull;
 
+	// account for the samples about to overwrite [startIndex, startIndex + numSamples) of a channel
+	void updateSquareSum(int channel, int startIndex, const Type* incoming, int numSamples) noexcept
+	{
+		const Type* outgoing = audiobuffer.getReadPointer(channel, startIndex);
+		int64 sum = squareSums[channel];
+
+		for (int i = 0; i < numSamples; i++)
+		{
+			sum += toFixedPointSquare(incoming[i]) - toFixedPointSquare(outgoing[i]);
+		}
+		squareSums[channel] = sum;
+	}
+
 	void increaseOrigin (int numSamples)
 	{
 		origin += numSamples;
-		if (origin > size)
+		if (origin >= size)
 		{
 			origin -= size;
 			isFull = true;
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cmath>
+#include <limits>
+#include <JuceHeader.h>
+
+// Integrated loudness (EBU R128 / ITU-R BS.1770) and true peak of a tune, measured as its samples go by.
+//
+// The channels are K-weighted, their mean squares summed over gating blocks of 400 ms overlapping by
+// 75 %, then gated at -70 LUFS and at 10 LU under the loudness of the remaining blocks. The blocks are
+// kept as a histogram of 0.1 LU bins holding their energy, so the memory doesn't grow with the tune and
+// the relative gate is found at the end without a second pass. All the channels weigh 1, as the left,
+// right and centre ones do in the standard; this is a stereo recorder.
+//
+// The true peak is the highest magnitude of the signal oversampled 4 times (twice from 96 kHz, not at
+// all from 192 kHz) by a windowed sinc interpolator, as in annex 2 of BS.1770.
+//
+// reset() allocates, addBlock() doesn't. Not meant for the audio thread: the recorder feeds it from the
+// thread writing the file.
+class LoudnessMeter
+{
+public:
+    static constexpr double absoluteGate = -70.0;
+
+    void reset(double sampleRate, int numChannels)
+    {
+        this->numChannels = numChannels;
+        initialiseKWeighting(sampleRate);
+        filterStates.calloc((size_t)numChannels * 4);
+
+        stepLength = jmax(1, roundToInt(sampleRate * 0.1));
+        stepPosition = 0;
+        stepEnergy = 0;
+        numSteps = 0;
+        zeromem(stepEnergies, sizeof(stepEnergies));
+        zeromem(binEnergies, sizeof(binEnergies));
+        zeromem(binCounts, sizeof(binCounts));
+
+        oversampling = sampleRate < 96000 ? 4 : sampleRate < 192000 ? 2 : 1;
+        initialiseInterpolator();
+        history.calloc((size_t)numChannels * tapsPerPhase * 2);
+        historyPosition = 0;
+        truePeak = 0;
+    }
+
+    void addBlock(const float *const *channels, int numSamples) noexcept
+    {
+        for (int i = 0; i < numSamples; i++)
+        {
+            double energy = 0;
+            for (int channel = 0; channel < numChannels; channel++)
+            {
+                const float sample = channels[channel][i];
+                const double weighted = applyKWeighting(channel, sample);
+                energy += weighted * weighted;
+                updateTruePeak(channel, sample);
+            }
+            historyPosition = (historyPosition + 1) % tapsPerPhase;
+
+            stepEnergy += energy;
+            if (++stepPosition == stepLength)
+            {
+                finishStep();
+            }
+        }
+    }
+
+    // LUFS, -infinity while no block is above the absolute gate
+    double getIntegratedLoudness() const noexcept
+    {
+        double energy = 0;
+        int64 count = 0;
+        for (int i = 0; i < numBins; i++)
+        {
+            energy += binEnergies[i];
+            count += binCounts[i];
+        }
+        if (count == 0)
+        {
+            return -std::numeric_limits<double>::infinity();
+        }
+
+        const double relativeGate = energyToLoudness(energy / (double)count) - 10.0;
+        energy = 0;
+        count = 0;
+        for (int i = jmax(0, getBin(relativeGate)); i < numBins; i++)
+        {
+            energy += binEnergies[i];
+            count += binCounts[i];
+        }
+        return energyToLoudness(energy / (double)count);
+    }
+
+    // linear, 1 is full scale
+    float getTruePeak() const noexcept
+    {
+        return truePeak;
+    }
+
+private:
+    static constexpr int tapsPerPhase = 12;
+    static constexpr int numBins = 1000; // from -70 to +30 LUFS
+
+    int numChannels = 0;
+
+    // the pre-filter (a high shelf) and the RLB filter (a high pass) of BS.1770, as direct form II biquads
+    double shelfB[3] = {}, shelfA[3] = {}, highPassB[3] = {}, highPassA[3] = {};
+    HeapBlock<double> filterStates; // two per filter and channel
+
+    int stepLength = 0, stepPosition = 0;
+    double stepEnergy = 0;
+    double stepEnergies[4] = {}; // of the last 100 ms steps, a gating block is 4 of them
+    int64 numSteps = 0;
+    double binEnergies[numBins] = {};
+    int64 binCounts[numBins] = {};
+
+    int oversampling = 4;
+    float interpolator[4][tapsPerPhase] = {};
+    HeapBlock<float> history; // twice the taps per channel, so that the last ones are contiguous
+    int historyPosition = 0;
+    float truePeak = 0;
+
+    // the coefficients of BS.1770 are given at 48 kHz, these are their analog prototypes
+    void initialiseKWeighting(double sampleRate)
+    {
+        {
+            const double f0 = 1681.974450955533, gain = 3.999843853973347, q = 0.7071752369554196;
+            const double k = std::tan(MathConstants<double>::pi * f0 / sampleRate);
+            const double vh = std::pow(10.0, gain / 20.0), vb = std::pow(vh, 0.4996667741545416);
+            const double a0 = 1.0 + k / q + k * k;
+            shelfB[0] = (vh + vb * k / q + k * k) / a0;
+            shelfB[1] = 2.0 * (k * k - vh) / a0;
+            shelfB[2] = (vh - vb * k / q + k * k) / a0;
+            shelfA[1] = 2.0 * (k * k - 1.0) / a0;
+            shelfA[2] = (1.0 - k / q + k * k) / a0;
+        }
+        {
+            const double f0 = 38.13547087602444, q = 0.5003270373238773;
+            const double k = std::tan(MathConstants<double>::pi * f0 / sampleRate);
+            const double a0 = 1.0 + k / q + k * k;
+            highPassB[0] = 1.0;
+            highPassB[1] = -2.0;
+            highPassB[2] = 1.0;
+            highPassA[1] = 2.0 * (k * k - 1.0) / a0;
+            highPassA[2] = (1.0 - k / q + k * k) / a0;
+        }
+    }
+
+    double applyKWeighting(int channel, double sample) noexcept
+    {
+        double *state = filterStates + channel * 4;
+        return applyBiquad(highPassB, highPassA, state + 2, applyBiquad(shelfB, shelfA, state, sample));
+    }
+
+    static double applyBiquad(const double *b, const double *a, double *state, double input) noexcept
+    {
+        const double w = input - a[1] * state[0] - a[2] * state[1];
+        const double output = b[0] * w + b[1] * state[0] + b[2] * state[1];
+        state[1] = state[0];
+        state[0] = w;
+        return output;
+    }
+
+    void finishStep() noexcept
+    {
+        stepEnergies[numSteps % 4] = stepEnergy / (double)stepLength;
+        stepEnergy = 0;
+        stepPosition = 0;
+
+        if (++numSteps >= 4)
+        {
+            const double blockEnergy = (stepEnergies[0] + stepEnergies[1] + stepEnergies[2] + stepEnergies[3]) / 4.0;
+            const double loudness = energyToLoudness(blockEnergy);
+            if (loudness >= absoluteGate)
+            {
+                const int bin = jmin(numBins - 1, getBin(loudness));
+                binEnergies[bin] += blockEnergy;
+                ++binCounts[bin];
+            }
+        }
+    }
+
+    static double energyToLoudness(double energy) noexcept
+    {
+        return energy > 0 ? -0.691 + 10.0 * std::log10(energy) : -std::numeric_limits<double>::infinity();
+    }
+
+    static int getBin(double loudness) noexcept
+    {
+        return (int)std::floor((loudness - absoluteGate) * 10.0);
+    }
+
+    // a Hann windowed sinc, cut at the original Nyquist frequency, split into its phases
+    void initialiseInterpolator()
+    {
+        const int length = oversampling * tapsPerPhase;
+        for (int n = 0; n < length; n++)
+        {
+            const double x = (n - (length - 1) / 2.0) / oversampling;
+            const double sinc = x == 0 ? 1.0 : std::sin(MathConstants<double>::pi * x) / (MathConstants<double>::pi * x);
+            const double window = 0.5 - 0.5 * std::cos(MathConstants<double>::twoPi * (n + 0.5) / length);
+            interpolator[n % oversampling][n / oversampling] = (float)(sinc * window);
+        }
+    }
+
+    void updateTruePeak(int channel, float sample) noexcept
+    {
+        float *channelHistory = history + channel * tapsPerPhase * 2;
+        channelHistory[historyPosition] = sample;
+        channelHistory[historyPosition + tapsPerPhase] = sample;
+
+        // the newest sample first
+        const float *window = channelHistory + historyPosition + 1;
+        float peak = std::abs(sample);
+        for (int phase = 0; phase < oversampling && oversampling > 1; phase++)
+        {
+            float value = 0;
+            for (int tap = 0; tap < tapsPerPhase; tap++)
+            {
+                value += interpolator[phase][tap] * window[tapsPerPhase - 1 - tap];
+            }
+            peak = jmax(peak, std::abs(value));
+        }
+        truePeak = jmax(truePeak, peak);
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(LoudnessMeter)
+};
\ No newline at end of file
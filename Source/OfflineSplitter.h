@@ -0,0 +1,241 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "ParallelSilenceAnalysis.h"
+#include "PostRecordJob.h"
+#include "SilenceDetector.h"
+#include "TuneStatistics.h"
+
+// Splits an existing long recording into tunes the way AudioRecorder does it live: same detection,
+// same pre-roll, same "Tune N" files and same post-record treatment, but reading the file as fast
+// as the disk allows. The tunes of an input go to a folder named after it.
+class OfflineSplitter
+{
+public:
+    struct Settings
+    {
+        File outputFolder;
+        String outputExtension = ".flac";
+        float RMSThreshold = 0.01f;
+        float silenceLength = 2.0f;
+        bool normalize = true;
+        bool normalizeLoudness = false;
+        float loudnessTarget = PostRecordJob::defaultLoudnessTarget;
+        bool trim = true;
+        bool removeChunks = true;
+        int chunkMaxSize = 10;
+        int blockSize = 512; // the detection is evaluated after each block, like after each audio callback
+        ThreadPool *pool = nullptr; // when set, the file is analysed and its tunes written with all the pool threads
+    };
+
+    OfflineSplitter(const Settings &settings)
+        : settings(settings)
+    {
+        formatManager.registerBasicFormats();
+    }
+
+    // returns the number of tunes written, or -1 if the file can't be read
+    int process(const File &input)
+    {
+        std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(input));
+        if (reader == nullptr)
+        {
+            return -1;
+        }
+
+        const int numChannels = (int)reader->numChannels;
+        const int windowSize = (int)(reader->sampleRate * settings.silenceLength);
+        const int blockSize = jmin(settings.blockSize, windowSize);
+
+        folder = settings.outputFolder.getChildFile(input.getFileNameWithoutExtension());
+        if (settings.pool != nullptr)
+        {
+            return processInParallel(input, *reader, windowSize, blockSize);
+        }
+
+        SilenceDetector detector;
+        detector.prepare(numChannels, windowSize);
+        detector.setThreshold(settings.RMSThreshold);
+
+        AudioBuffer<float> block(numChannels, blockSize);
+        Tune tune;
+        int numTunes = 0;
+
+        for (int64 position = 0; position < reader->lengthInSamples; position += blockSize)
+        {
+            const int numSamples = (int)jmin((int64)blockSize, reader->lengthInSamples - position);
+            reader->read(&block, 0, numSamples, position, true, true);
+            AudioBuffer<float> samples(block.getArrayOfWritePointers(), numChannels, numSamples);
+
+            switch (detector.process(samples))
+            {
+            case SilenceDetector::Event::silenceStarted:
+                finishTune(tune);
+                break;
+            case SilenceDetector::Event::soundStarted:
+                if (startTune(tune, getNextTuneFile(), *reader))
+                {
+                    ++numTunes;
+                    // the memory already ends with this block
+                    writeMemory(tune, detector.getMemory());
+                }
+                break;
+            default:
+                if (!detector.isSilence())
+                {
+                    write(tune, samples.getArrayOfReadPointers(), numSamples);
+                }
+                break;
+            }
+        }
+
+        finishTune(tune);
+        return numTunes;
+    }
+
+private:
+    Settings settings;
+    AudioFormatManager formatManager;
+    File folder;
+
+    struct Tune
+    {
+        File file;
+        std::unique_ptr<AudioFormatWriter> writer;
+        TuneStatisticsAccumulator statistics;
+        LoudnessMeter loudnessMeter;
+    };
+
+    // The analysis gives the sample ranges of the tunes, which are then written at the same time, one
+    // per pool thread. The file names are taken before, in order; unlike in the sequential mode, the
+    // name of a tune removed by the post-record treatment isn't reused by the next one.
+    int processInParallel(const File &input, const AudioFormatReader &reader, int windowSize, int blockSize)
+    {
+        auto tunes = ParallelSilenceAnalysis::findTunes(input, formatManager, *settings.pool, windowSize, blockSize,
+                                                        settings.RMSThreshold);
+        Array<File> files;
+        for (int i = 0; i < tunes.size(); i++)
+        {
+            files.add(getNextTuneFile());
+            files.getReference(i).create();
+        }
+
+        std::atomic<int> numTunes{0};
+        ParallelSilenceAnalysis::runInParallel(*settings.pool, tunes.size(), [&](int index) {
+            std::unique_ptr<AudioFormatReader> tuneReader(formatManager.createReaderFor(input));
+            Tune tune;
+            if (tuneReader == nullptr || !startTune(tune, files[index], reader))
+            {
+                files[index].deleteFile();
+                return;
+            }
+            ++numTunes;
+
+            const auto range = tunes[index];
+            AudioBuffer<float> buffer((int)reader.numChannels, 1 << 16);
+            for (int64 position = range.getStart(); position < range.getEnd(); position += buffer.getNumSamples())
+            {
+                const int numSamples = (int)jmin((int64)buffer.getNumSamples(), range.getEnd() - position);
+                tuneReader->read(&buffer, 0, numSamples, position, true, true);
+                write(tune, buffer.getArrayOfReadPointers(), numSamples);
+            }
+            finishTune(tune);
+        });
+        return numTunes;
+    }
+
+    File getNextTuneFile()
+    {
+        folder.createDirectory(); // if not exists
+        return folder.getNonexistentChildFile(String("Tune "), settings.outputExtension, false);
+    }
+
+    bool startTune(Tune &tune, const File &file, const AudioFormatReader &reader)
+    {
+        tune.file = file;
+
+        auto *audioFormat = formatManager.findFormatForFileExtension(settings.outputExtension);
+        if (audioFormat == nullptr)
+        {
+            return false;
+        }
+
+        if (auto fileStream = std::unique_ptr<FileOutputStream>(tune.file.createOutputStream()))
+        {
+            tune.writer.reset(audioFormat->createWriterFor(fileStream.get(), reader.sampleRate, reader.numChannels,
+                                                      getSupportedBitDepth(*audioFormat, (int)reader.bitsPerSample), {}, 3));
+            if (tune.writer != nullptr)
+            {
+                fileStream.release(); // (passes responsibility for deleting the stream to the writer object that is now using it)
+                tune.statistics.reset(reader.sampleRate, settings.RMSThreshold);
+                if (settings.normalize && settings.normalizeLoudness)
+                {
+                    tune.loudnessMeter.reset(reader.sampleRate, (int)reader.numChannels);
+                }
+                return true;
+            }
+        }
+        tune.file.deleteFile();
+        return false;
+    }
+
+    void finishTune(Tune &tune)
+    {
+        if (tune.writer == nullptr)
+        {
+            return;
+        }
+        tune.writer.reset();
+
+        auto statistics = tune.statistics.getStatistics();
+        if (settings.normalize && settings.normalizeLoudness)
+        {
+            PostRecordJob::setLoudness(statistics, tune.loudnessMeter);
+        }
+
+        PostRecordJob job(nullptr,
+                          tune.file,
+                          statistics,
+                          settings.normalize,
+                          settings.trim,
+                          settings.removeChunks,
+                          &formatManager,
+                          settings.RMSThreshold,
+                          settings.chunkMaxSize,
+                          settings.normalizeLoudness,
+                          settings.loudnessTarget);
+        job.run(nullptr);
+    }
+
+    void write(Tune &tune, const float *const *channels, int numSamples)
+    {
+        if (tune.writer != nullptr && tune.writer->writeFromFloatArrays(channels, (int)tune.writer->getNumChannels(), numSamples))
+        {
+            tune.statistics.addBlock(channels, (int)tune.writer->getNumChannels(), numSamples);
+            if (settings.normalize && settings.normalizeLoudness)
+            {
+                tune.loudnessMeter.addBlock(channels, numSamples);
+            }
+        }
+    }
+
+    void writeMemory(Tune &tune, CircularBuffer<float> &memoryBuffer)
+    {
+        CircularBuffer<float>::Segment oldest, newest;
+        memoryBuffer.getSegments(oldest, newest);
+        write(tune, oldest.channels, oldest.numSamples);
+        write(tune, newest.channels, newest.numSamples);
+    }
+
+    static int getSupportedBitDepth(AudioFormat &audioFormat, int bitDepth)
+    {
+        auto possibleBitDepths = audioFormat.getPossibleBitDepths();
+        if (possibleBitDepths.contains(bitDepth))
+        {
+            return bitDepth;
+        }
+        return bitDepth > 16 && possibleBitDepths.contains(24) ? 24 : 16;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(OfflineSplitter)
+};
\ No newline at end of file
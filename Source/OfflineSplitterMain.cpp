@@ -0,0 +1,115 @@
+/*
+  ==============================================================================
+
+    Console entry point of CollectionSplitter: splits existing recordings into
+    tunes, several input files at a time.
+
+  ==============================================================================
+*/
+
+#include <iostream>
+#include <JuceHeader.h>
+#include "OfflineSplitter.h"
+
+static void printUsage()
+{
+    std::cout << "Usage: CollectionSplitter [options] file..." << std::endl
+              << "  --output=<folder>        destination folder (default: next to each input file)" << std::endl
+              << "  --format=wav|flac        output format (default: flac)" << std::endl
+              << "  --threshold=<rms>        silence RMS threshold (default: 0.01)" << std::endl
+              << "  --silence=<seconds>      silence length splitting tunes (default: 2)" << std::endl
+              << "  --chunk-max-size=<s>     tunes shorter than this are removed (default: 10)" << std::endl
+              << "  --no-normalize, --no-trim, --no-remove-chunks" << std::endl
+              << "  --loudness=<LUFS>        normalize to this integrated loudness rather than the peak to 0.99" << std::endl
+              << "  --block-size=<samples>   detection granularity, the live audio buffer size (default: 512)" << std::endl
+              << "  --jobs=<n>               threads: files processed at the same time, or chunks of a single file (default: number of cores)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    ArgumentList args(argc, argv);
+
+    Array<File> inputs;
+    for (auto &argument : args.arguments)
+    {
+        if (!argument.isOption())
+        {
+            inputs.add(argument.resolveAsFile());
+        }
+    }
+
+    if (inputs.isEmpty() || args.containsOption("--help|-h"))
+    {
+        printUsage();
+        return inputs.isEmpty() ? 1 : 0;
+    }
+
+    OfflineSplitter::Settings settings;
+    settings.outputExtension = args.containsOption("--format") && args.getValueForOption("--format") == "wav" ? ".wav" : ".flac";
+    if (args.containsOption("--threshold"))
+        settings.RMSThreshold = args.getValueForOption("--threshold").getFloatValue();
+    if (args.containsOption("--silence"))
+        settings.silenceLength = args.getValueForOption("--silence").getFloatValue();
+    if (args.containsOption("--chunk-max-size"))
+        settings.chunkMaxSize = args.getValueForOption("--chunk-max-size").getIntValue();
+    if (args.containsOption("--block-size"))
+        settings.blockSize = jmax(1, args.getValueForOption("--block-size").getIntValue());
+    settings.normalize = !args.containsOption("--no-normalize");
+    if (args.containsOption("--loudness"))
+    {
+        settings.normalizeLoudness = true;
+        settings.loudnessTarget = args.getValueForOption("--loudness").getFloatValue();
+    }
+    settings.trim = !args.containsOption("--no-trim");
+    settings.removeChunks = !args.containsOption("--no-remove-chunks");
+
+    const int numJobs = args.containsOption("--jobs") ? jmax(1, args.getValueForOption("--jobs").getIntValue())
+                                                      : SystemStats::getNumCpus();
+    const File outputFolder = args.containsOption("--output") ? args.getFileForOption("--output") : File();
+
+    ThreadPool pool(numJobs);
+    CriticalSection outputLock;
+    std::atomic<int> numFailures{0};
+
+    auto splitFile = [=, &pool, &outputLock, &numFailures](const File &input, bool useWholePool) {
+        auto fileSettings = settings;
+        fileSettings.outputFolder = outputFolder == File() ? input.getParentDirectory() : outputFolder;
+        fileSettings.pool = useWholePool ? &pool : nullptr;
+
+        OfflineSplitter splitter(fileSettings);
+        const auto startTime = Time::getMillisecondCounterHiRes();
+        const int numTunes = splitter.process(input);
+
+        const ScopedLock sl(outputLock);
+        if (numTunes < 0)
+        {
+            ++numFailures;
+            std::cerr << input.getFullPathName() << ": can't be read" << std::endl;
+        }
+        else
+        {
+            std::cout << input.getFullPathName() << ": " << numTunes << " tunes in "
+                      << String((Time::getMillisecondCounterHiRes() - startTime) / 1000.0, 1) << " s" << std::endl;
+        }
+    };
+
+    if (inputs.size() == 1)
+    {
+        // a single file is cut into chunks analysed on all the threads
+        splitFile(inputs.getFirst(), true);
+    }
+    else
+    {
+        for (auto &input : inputs)
+        {
+            pool.addJob([=] { splitFile(input, false); });
+        }
+    }
+
+    while (pool.getNumJobs() > 0)
+    {
+        Thread::sleep(50);
+    }
+
+    return numFailures > 0 ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,653 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// The threads that encode the FLAC segments, shared by all the writers of the application
+struct FlacEncoderThreads
+{
+    ThreadPool pool{ jmax(1, SystemStats::getNumCpus() - 1) };
+};
+
+// A FLAC writer that encodes on several cores, for the sample rates and channel counts one core can't keep up with.
+//
+// The samples are cut into segments of a whole number of FLAC blocks, and each segment is encoded on its own by
+// the writer of FlacAudioFormat, into memory, on the shared encoder pool. libFLAC hands its output over one frame
+// at a time, so the frames of a segment can be told apart; they are numbered from 0, the worker renumbers them
+// (their header and their CRCs) once it knows where the segment goes. The frames are then written in order,
+// behind a STREAMINFO which is completed when the writer is closed. The MD5 of the samples is left unset, as
+// the FLAC writer of JUCE does.
+//
+// A SEEKTABLE follows the STREAMINFO, with a point every seekPointInterval seconds, so that libFLAC (and
+// so the FLAC reader of JUCE) seeks straight to a frame near the target instead of searching for it.
+// Its size is reserved up front: when a long file fills it, one point out of two is dropped.
+class ParallelFlacWriter : public AudioFormatWriter
+{
+public:
+    static constexpr double defaultSeekPointInterval = 10.0;
+
+    // no SEEKTABLE with a seekPointInterval of 0
+    ParallelFlacWriter(OutputStream *out, double sampleRate, unsigned int numChannels, unsigned int bitsPerSample, int qualityOptionIndex,
+                       double seekPointInterval = defaultSeekPointInterval)
+        : AudioFormatWriter(out, "FLAC file", sampleRate, numChannels, bitsPerSample),
+          qualityOptionIndex(qualityOptionIndex),
+          numSeekPoints(seekPointInterval > 0 ? maxSeekPoints : 0),
+          seekPointSpacing(jmax((int64)1, (int64)(seekPointInterval * sampleRate)))
+    {
+        headerPosition = output->getPosition();
+        writeMetadata(); // a placeholder, until the length, the frame sizes and the seek points are known
+    }
+
+    ~ParallelFlacWriter() override
+    {
+        if (current != nullptr && current->numSamples > 0)
+        {
+            startEncoding();
+        }
+        writeEncodedSegments(0);
+
+        const int64 end = output->getPosition();
+        if (output->setPosition(headerPosition))
+        {
+            writeMetadata();
+            output->setPosition(end);
+        }
+        output->flush();
+    }
+
+    bool write(const int **samplesToWrite, int numSamples) override
+    {
+        if (outputFailed)
+        {
+            return false;
+        }
+
+        for (int done = 0; done < numSamples;)
+        {
+            if (current == nullptr)
+            {
+                current = getFreeSegment();
+            }
+
+            const int length = jmin(numSamples - done, segmentLength - current->numSamples);
+            for (int i = 0; i < (int)numChannels; i++)
+            {
+                int *destination = current->channels[i] + current->numSamples;
+                if (samplesToWrite[i] != nullptr)
+                    memcpy(destination, samplesToWrite[i] + done, (size_t)length * sizeof(int));
+                else
+                    zeromem(destination, (size_t)length * sizeof(int));
+            }
+            current->numSamples += length;
+            done += length;
+
+            if (current->numSamples == segmentLength)
+            {
+                startEncoding();
+                if (!writeEncodedSegments(maxPendingSegments))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // An interrupted recording keeps the metadata written when it was created: no length, no frame sizes,
+    // a SEEKTABLE of placeholders. Its frames are whole up to the crash: each one ends where the CRC-16 of
+    // its bytes checks, at the next frame header or the end of the file. They are scanned, the one the
+    // crash cut is removed with what follows it, and the STREAMINFO and the SEEKTABLE are written from
+    // them. Returns the number of samples, or -1 when the file isn't a FLAC file without a length.
+    static int64 repairInterruptedFile(const File &file, double seekPointInterval = defaultSeekPointInterval)
+    {
+        Array<SeekPoint> frames; // all of them, with their offset from the first one
+        int64 streamEnd = 0, seekTableOffset = -1;
+        int numTablePoints = 0, maxBlockSize = 0;
+        int minFrame = 0, maxFrame = 0;
+        uint8 channelsAndLength = 0;
+        int64 numSamples = 0;
+        double rate = 0;
+        {
+            MemoryMappedFile map(file, MemoryMappedFile::readOnly);
+            auto *bytes = static_cast<const uint8 *>(map.getData());
+            const int64 size = (int64)map.getSize();
+            if (bytes == nullptr || size < 42 || memcmp(bytes, "fLaC", 4) != 0 || (bytes[4] & 0x7f) != 0)
+            {
+                return -1;
+            }
+
+            const uint8 *info = bytes + 8;
+            if ((info[13] & 0x0f) != 0 || ByteOrder::bigEndianInt(info + 14) != 0)
+            {
+                return -1; // its length is known, it was closed
+            }
+            channelsAndLength = info[13];
+            rate = (double)((info[10] << 12) | (info[11] << 4) | (info[12] >> 4));
+
+            int64 firstFrame = 4;
+            for (bool isLast = false; !isLast;)
+            {
+                if (firstFrame + 4 > size)
+                {
+                    return -1;
+                }
+                isLast = (bytes[firstFrame] & 0x80) != 0;
+                const int64 length = (bytes[firstFrame + 1] << 16) | (bytes[firstFrame + 2] << 8) | bytes[firstFrame + 3];
+                if ((bytes[firstFrame] & 0x7f) == 3)
+                {
+                    seekTableOffset = firstFrame + 4;
+                    numTablePoints = (int)(length / 18);
+                }
+                firstFrame += 4 + length;
+            }
+
+            streamEnd = jmin(firstFrame, size);
+            for (int64 start = streamEnd; isFrameHeader(bytes + start, size - start);)
+            {
+                const int headerLength = getFrameHeaderLength(bytes + start) + 1;
+                uint16 crc = getCrc16(0, bytes + start, headerLength);
+                int64 end = -1;
+                for (int64 position = start + headerLength; position < size && end < 0; position++)
+                {
+                    crc = getCrc16(crc, bytes + position, 1);
+                    if (crc == 0 && (position + 1 == size || isFrameHeader(bytes + position + 1, size - position - 1)))
+                    {
+                        end = position + 1;
+                    }
+                }
+                if (end < 0)
+                {
+                    break; // cut by the crash
+                }
+
+                const int frameSize = (int)(end - start);
+                const int frameSamples = getFrameBlockSize(bytes + start);
+                frames.add({ numSamples, start - firstFrame, frameSamples });
+                numSamples += frameSamples;
+                minFrame = minFrame == 0 ? frameSize : jmin(minFrame, frameSize);
+                maxFrame = jmax(maxFrame, frameSize);
+                maxBlockSize = jmax(maxBlockSize, frameSamples);
+                start = streamEnd = end;
+            }
+        } // unmapped before it is written
+
+        if (frames.isEmpty())
+        {
+            return 0; // nothing was recorded, the placeholder stays
+        }
+
+        FileOutputStream output(file);
+        if (!output.openedOk() || !output.setPosition(streamEnd) || output.truncate().failed())
+        {
+            return -1;
+        }
+
+        // the block size of all the frames but the last one
+        const uint8 info[10] = { (uint8)(maxBlockSize >> 8), (uint8)maxBlockSize, (uint8)(maxBlockSize >> 8), (uint8)maxBlockSize,
+                                 (uint8)(minFrame >> 16), (uint8)(minFrame >> 8), (uint8)minFrame,
+                                 (uint8)(maxFrame >> 16), (uint8)(maxFrame >> 8), (uint8)maxFrame };
+        output.setPosition(8);
+        output.write(info, sizeof(info));
+        output.setPosition(8 + 13);
+        output.writeByte((char)((channelsAndLength & 0xf0) | ((numSamples >> 32) & 0x0f)));
+        output.writeIntBigEndian((int)(uint32)numSamples);
+
+        if (seekTableOffset >= 0 && maxBlockSize > 0)
+        {
+            // the spacing of the writer, doubled until the points fit in the table
+            int64 spacing = jmax((int64)1, (int64)(seekPointInterval * rate));
+            while (numTablePoints > 0 && (numSamples + spacing - 1) / spacing > numTablePoints)
+            {
+                spacing *= 2;
+            }
+
+            Array<SeekPoint> points;
+            for (auto &frame : frames)
+            {
+                if (points.size() < numTablePoints && frame.sample >= (points.isEmpty() ? 0 : (points.getLast().sample / spacing + 1) * spacing))
+                {
+                    points.add(frame);
+                }
+            }
+
+            output.setPosition(seekTableOffset);
+            for (int i = 0; i < numTablePoints; i++)
+            {
+                const bool isUsed = i < points.size();
+                output.writeInt64BigEndian(isUsed ? points.getReference(i).sample : (int64)-1);
+                output.writeInt64BigEndian(isUsed ? points.getReference(i).offset : 0);
+                output.writeShortBigEndian((short)(isUsed ? points.getReference(i).numSamples : 0));
+            }
+        }
+        output.flush();
+        return numSamples;
+    }
+
+private:
+    // a multiple of every block size libFLAC uses (1152 and 4096), so that only the last frame of the file is short
+    static constexpr int segmentLength = 36864 * 2;
+    static constexpr int maxSeekPoints = 256; // 4.5 kB, a point every 10 s for 42 minutes
+
+    struct Segment
+    {
+        HeapBlock<int> samples;
+        HeapBlock<int *> channels;
+        int numSamples = 0;
+        int64 index = 0;
+
+        // set by the worker
+        MemoryBlock frames;
+        Array<int> frameSizes;
+        int blockSize = 0;
+        int minFrameSize = 0, maxFrameSize = 0;
+        bool failed = false;
+        WaitableEvent encoded;
+    };
+
+    // libFLAC writes each frame in a single call: the calls that start with a frame sync code give the frame boundaries
+    class FrameCollectingStream : public MemoryOutputStream
+    {
+    public:
+        FrameCollectingStream(MemoryBlock &destination, Array<int> &frameStarts)
+            : MemoryOutputStream(destination, false),
+              frameStarts(frameStarts)
+        {
+        }
+
+        bool write(const void *data, size_t numBytes) override
+        {
+            auto *bytes = static_cast<const uint8 *>(data);
+            if (numBytes >= 2 && bytes[0] == 0xff && bytes[1] == 0xf8 && getPosition() == (int64)getDataSize())
+            {
+                frameStarts.add((int)getPosition());
+            }
+            return MemoryOutputStream::write(data, numBytes);
+        }
+
+    private:
+        Array<int> &frameStarts;
+    };
+
+    const int qualityOptionIndex;
+    SharedResourcePointer<FlacEncoderThreads> encoderThreads;
+    const int maxPendingSegments = encoderThreads->pool.getNumThreads() * 2; // bounds the memory when the disk is the bottleneck
+    OwnedArray<Segment> pendingSegments; // in the order of the file
+    OwnedArray<Segment> freeSegments;
+    Segment *current = nullptr;
+    int64 numSegments = 0;
+    bool outputFailed = false; // the disk is full or gone: nothing more is written after the last whole segment
+
+    int64 headerPosition = 0;
+    int64 totalSamples = 0;
+    int blockSize = 0;
+    int minFrameSize = 0, maxFrameSize = 0;
+
+    struct SeekPoint
+    {
+        int64 sample;
+        int64 offset; // from the first frame
+        int numSamples;
+    };
+
+    const int numSeekPoints;
+    int64 seekPointSpacing;
+    int64 nextSeekPointSample = 0;
+    int64 frameBytes = 0;
+    Array<SeekPoint> seekPoints;
+
+    Segment *getFreeSegment()
+    {
+        if (freeSegments.size() > 0)
+        {
+            auto *segment = freeSegments.removeAndReturn(freeSegments.size() - 1);
+            segment->numSamples = 0;
+            return segment;
+        }
+
+        auto *segment = new Segment();
+        segment->samples.malloc((size_t)numChannels * segmentLength);
+        segment->channels.malloc(numChannels);
+        for (int i = 0; i < (int)numChannels; i++)
+        {
+            segment->channels[i] = segment->samples + (size_t)i * segmentLength;
+        }
+        return segment;
+    }
+
+    void startEncoding()
+    {
+        auto *segment = current;
+        current = nullptr;
+        segment->index = numSegments++;
+        segment->frames.reset();
+        segment->frameSizes.clearQuick();
+        segment->failed = false;
+        pendingSegments.add(segment);
+
+        const double rate = sampleRate;
+        const int channels = (int)numChannels, bits = (int)bitsPerSample, quality = qualityOptionIndex;
+        encoderThreads->pool.addJob([segment, rate, channels, bits, quality] {
+            encode(*segment, rate, channels, bits, quality);
+            segment->encoded.signal();
+        });
+    }
+
+    // writes the segments that are encoded, in order, waiting for the oldest ones while more than maxPending are left;
+    // the metadata only counts the segments written whole, those after a failed write are dropped
+    bool writeEncodedSegments(int maxPending)
+    {
+        bool ok = true;
+        while (pendingSegments.size() > 0)
+        {
+            auto *segment = pendingSegments.getFirst();
+            if (!segment->encoded.wait(pendingSegments.size() > maxPending ? -1 : 0))
+            {
+                break;
+            }
+
+            if (segment->failed)
+            {
+                ok = false;
+            }
+            else if (outputFailed || !output->write(segment->frames.getData(), segment->frames.getSize()))
+            {
+                outputFailed = true;
+                ok = false;
+            }
+            else
+            {
+                blockSize = segment->blockSize;
+                addSeekPoints(*segment);
+                totalSamples += segment->numSamples;
+                minFrameSize = minFrameSize == 0 ? segment->minFrameSize : jmin(minFrameSize, segment->minFrameSize);
+                maxFrameSize = jmax(maxFrameSize, segment->maxFrameSize);
+            }
+            freeSegments.add(pendingSegments.removeAndReturn(0));
+        }
+        return ok;
+    }
+
+    // the first frame at or after each multiple of the spacing
+    void addSeekPoints(const Segment &segment)
+    {
+        int64 frameSample = totalSamples;
+        const int64 segmentEnd = totalSamples + segment.numSamples;
+        for (auto frameSize : segment.frameSizes)
+        {
+            if (numSeekPoints > 0 && frameSample >= nextSeekPointSample)
+            {
+                addSeekPoint({ frameSample, frameBytes, (int)jmin((int64)segment.blockSize, segmentEnd - frameSample) });
+            }
+            frameBytes += frameSize;
+            frameSample += segment.blockSize;
+        }
+    }
+
+    void addSeekPoint(const SeekPoint &point)
+    {
+        if (seekPoints.size() == numSeekPoints)
+        {
+            // the table is full: the points of the odd multiples go, the spacing doubles
+            for (int i = seekPoints.size() - 1; i > 0; i--)
+            {
+                if (i % 2 != 0)
+                {
+                    seekPoints.remove(i);
+                }
+            }
+            seekPointSpacing *= 2;
+            nextSeekPointSample = (seekPoints.getLast().sample / seekPointSpacing + 1) * seekPointSpacing;
+            if (point.sample < nextSeekPointSample)
+            {
+                return;
+            }
+        }
+        seekPoints.add(point);
+        nextSeekPointSample = (point.sample / seekPointSpacing + 1) * seekPointSpacing;
+    }
+
+    // worker thread
+    static void encode(Segment &segment, double sampleRate, int numChannels, int bitsPerSample, int qualityOptionIndex)
+    {
+        MemoryBlock encoded;
+        Array<int> frameStarts;
+        {
+            FlacAudioFormat flacFormat;
+            std::unique_ptr<AudioFormatWriter> writer(flacFormat.createWriterFor(new FrameCollectingStream(encoded, frameStarts), sampleRate,
+                                                                                 (unsigned int)numChannels, bitsPerSample, {}, qualityOptionIndex));
+            if (writer == nullptr || !writer->write(const_cast<const int **>(segment.channels.get()), segment.numSamples))
+            {
+                segment.failed = true;
+                return;
+            }
+        } // closes the stream, the last frame is written
+
+        // "fLaC", then the STREAMINFO header, then its minimum block size
+        auto *bytes = static_cast<const uint8 *>(encoded.getData());
+        if (encoded.getSize() < 10 || frameStarts.isEmpty())
+        {
+            segment.failed = true;
+            return;
+        }
+        segment.blockSize = (bytes[8] << 8) | bytes[9];
+
+        int64 frameNumber = segment.index * (segmentLength / segment.blockSize);
+        MemoryOutputStream frames(segment.frames, false);
+        for (int i = 0; i < frameStarts.size(); i++)
+        {
+            const int end = i + 1 < frameStarts.size() ? frameStarts[i + 1] : (int)encoded.getSize();
+            const int frameSize = writeRenumberedFrame(frames, bytes + frameStarts[i], end - frameStarts[i], frameNumber++);
+            segment.frameSizes.add(frameSize);
+            segment.minFrameSize = i == 0 ? frameSize : jmin(segment.minFrameSize, frameSize);
+            segment.maxFrameSize = jmax(segment.maxFrameSize, frameSize);
+        }
+    }
+
+    // returns the size of the frame, which grows when its number takes more bytes
+    static int writeRenumberedFrame(OutputStream &out, const uint8 *frame, int size, int64 frameNumber)
+    {
+        const int numberLength = getCodedNumberLength(frame[4]);
+        const int oldHeaderLength = getFrameHeaderLength(frame);
+        const int extraLength = oldHeaderLength - 4 - numberLength;
+
+        uint8 header[24];
+        memcpy(header, frame, 4);
+        int headerLength = 4 + writeCodedNumber(header + 4, frameNumber);
+        memcpy(header + headerLength, frame + 4 + numberLength, (size_t)extraLength);
+        headerLength += extraLength;
+        header[headerLength] = getCrc8(header, headerLength);
+        headerLength++;
+
+        // the subframes don't change, only the CRC-16 of the whole frame
+        const uint8 *body = frame + oldHeaderLength + 1;
+        const int bodyLength = size - (oldHeaderLength + 1) - 2;
+        const uint16 crc = getCrc16(getCrc16(0, header, headerLength), body, bodyLength);
+        const uint8 crcBytes[2] = { (uint8)(crc >> 8), (uint8)crc };
+
+        out.write(header, (size_t)headerLength);
+        out.write(body, (size_t)bodyLength);
+        out.write(crcBytes, 2);
+        return headerLength + bodyLength + 2;
+    }
+
+    // sync code, block size and sample rate codes, channels and sample size, the frame number, then the
+    // block size and the sample rate that don't have a code; without its CRC-8
+    static int getFrameHeaderLength(const uint8 *frame)
+    {
+        const int blockSizeCode = frame[2] >> 4, sampleRateCode = frame[2] & 0x0f;
+        return 4 + getCodedNumberLength(frame[4])
+               + (blockSizeCode == 6 ? 1 : blockSizeCode == 7 ? 2 : 0)
+               + (sampleRateCode == 12 ? 1 : (sampleRateCode == 13 || sampleRateCode == 14) ? 2 : 0);
+    }
+
+    // a fixed block size frame header whose CRC-8 checks, within the available bytes
+    static bool isFrameHeader(const uint8 *frame, int64 available)
+    {
+        if (available < 5 || frame[0] != 0xff || frame[1] != 0xf8 || (frame[2] >> 4) == 0 || (frame[2] & 0x0f) == 0x0f)
+        {
+            return false;
+        }
+        const int headerLength = getFrameHeaderLength(frame);
+        return headerLength < available && getCrc8(frame, headerLength) == frame[headerLength];
+    }
+
+    static int getFrameBlockSize(const uint8 *frame)
+    {
+        const int code = frame[2] >> 4;
+        const uint8 *extra = frame + 4 + getCodedNumberLength(frame[4]);
+        if (code == 1)
+            return 192;
+        if (code <= 5)
+            return 576 << (code - 2);
+        if (code == 6)
+            return extra[0] + 1;
+        if (code == 7)
+            return ((extra[0] << 8) | extra[1]) + 1;
+        return 256 << (code - 8);
+    }
+
+    // the frame number is coded like UTF-8, from 1 to 7 bytes
+    static int getCodedNumberLength(uint8 firstByte)
+    {
+        int length = 1;
+        if ((firstByte & 0x80) != 0)
+        {
+            while (length < 7 && (firstByte & (0x80 >> length)) != 0)
+            {
+                ++length;
+            }
+        }
+        return length;
+    }
+
+    static int writeCodedNumber(uint8 *destination, int64 value)
+    {
+        if (value < 0x80)
+        {
+            destination[0] = (uint8)value;
+            return 1;
+        }
+
+        int length = 2;
+        while (length < 7 && value >= ((int64)1 << (5 * length + 1)))
+        {
+            ++length;
+        }
+        for (int i = length - 1; i > 0; i--)
+        {
+            destination[i] = (uint8)(0x80 | (value & 0x3f));
+            value >>= 6;
+        }
+        destination[0] = (uint8)((0xff << (8 - length)) | value);
+        return length;
+    }
+
+    static uint8 getCrc8(const uint8 *data, int size)
+    {
+        uint8 crc = 0;
+        for (int i = 0; i < size; i++)
+        {
+            crc ^= data[i];
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (uint8)((crc & 0x80) != 0 ? (crc << 1) ^ 0x07 : crc << 1);
+            }
+        }
+        return crc;
+    }
+
+    static uint16 getCrc16(uint16 crc, const uint8 *data, int size)
+    {
+        static const auto table = [] {
+            std::array<uint16, 256> values;
+            for (int i = 0; i < 256; i++)
+            {
+                uint16 value = (uint16)(i << 8);
+                for (int bit = 0; bit < 8; bit++)
+                {
+                    value = (uint16)((value & 0x8000) != 0 ? (value << 1) ^ 0x8005 : value << 1);
+                }
+                values[(size_t)i] = value;
+            }
+            return values;
+        }();
+
+        for (int i = 0; i < size; i++)
+        {
+            crc = (uint16)((crc << 8) ^ table[(size_t)((crc >> 8) ^ data[i])]);
+        }
+        return crc;
+    }
+
+    void writeMetadata()
+    {
+        const int size = blockSize > 0 ? blockSize : 4096;
+        const uint32 rate = (uint32)sampleRate;
+        const uint32 channelsAndBits = ((numChannels - 1) << 5) | (bitsPerSample - 1);
+
+        // the last metadata block when there's no SEEKTABLE, 34 bytes
+        uint8 header[42] = { 'f', 'L', 'a', 'C', (uint8)(numSeekPoints > 0 ? 0 : 0x80), 0, 0, 34 };
+        uint8 *info = header + 8;
+        info[0] = info[2] = (uint8)(size >> 8);
+        info[1] = info[3] = (uint8)size;
+        info[4] = (uint8)(minFrameSize >> 16);
+        info[5] = (uint8)(minFrameSize >> 8);
+        info[6] = (uint8)minFrameSize;
+        info[7] = (uint8)(maxFrameSize >> 16);
+        info[8] = (uint8)(maxFrameSize >> 8);
+        info[9] = (uint8)maxFrameSize;
+        // 20 bits of sample rate, 3 of channels, 5 of sample size, 36 of length
+        info[10] = (uint8)(rate >> 12);
+        info[11] = (uint8)(rate >> 4);
+        info[12] = (uint8)(((rate & 0x0f) << 4) | (channelsAndBits >> 4));
+        info[13] = (uint8)(((channelsAndBits & 0x0f) << 4) | ((totalSamples >> 32) & 0x0f));
+        info[14] = (uint8)(totalSamples >> 24);
+        info[15] = (uint8)(totalSamples >> 16);
+        info[16] = (uint8)(totalSamples >> 8);
+        info[17] = (uint8)totalSamples;
+        // the MD5 signature stays at 0: unknown
+
+        output->write(header, sizeof(header));
+
+        if (numSeekPoints > 0)
+        {
+            const int tableSize = numSeekPoints * 18;
+            output->writeByte((char)0x83); // the last metadata block, a SEEKTABLE
+            output->writeByte((char)(tableSize >> 16));
+            output->writeShortBigEndian((short)tableSize);
+            for (int i = 0; i < numSeekPoints; i++)
+            {
+                // the points that aren't used yet are placeholders
+                const bool isUsed = i < seekPoints.size();
+                output->writeInt64BigEndian(isUsed ? seekPoints.getReference(i).sample : (int64)-1);
+                output->writeInt64BigEndian(isUsed ? seekPoints.getReference(i).offset : 0);
+                output->writeShortBigEndian((short)(isUsed ? seekPoints.getReference(i).numSamples : 0));
+            }
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ParallelFlacWriter)
+};
+
+// FlacAudioFormat, with ParallelFlacWriter as its writer
+class ParallelFlacAudioFormat : public FlacAudioFormat
+{
+public:
+    ParallelFlacAudioFormat(double seekPointInterval = ParallelFlacWriter::defaultSeekPointInterval)
+        : seekPointInterval(seekPointInterval)
+    {
+    }
+
+    AudioFormatWriter *createWriterFor(OutputStream *streamToWriteTo, double sampleRateToUse, unsigned int numberOfChannels,
+                                       int bitsPerSample, const StringPairArray &, int qualityOptionIndex) override
+    {
+        if (streamToWriteTo == nullptr || numberOfChannels == 0 || !getPossibleBitDepths().contains(bitsPerSample))
+        {
+            return nullptr;
+        }
+        return new ParallelFlacWriter(streamToWriteTo, sampleRateToUse, numberOfChannels, (unsigned int)bitsPerSample, qualityOptionIndex,
+                                      seekPointInterval);
+    }
+
+private:
+    const double seekPointInterval;
+};
\ No newline at end of file
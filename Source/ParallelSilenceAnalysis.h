@@ -0,0 +1,169 @@
+#pragma once
+
+#include <atomic>
+#include <JuceHeader.h>
+#include "CircularBuffer.h"
+#include "SilenceDetector.h"
+
+// Finds where the offline splitter cuts a long file into tunes with all the threads of a pool.
+//
+// The file is split into chunks of blocks, and each chunk computes the level SilenceDetector would
+// see after each of its blocks, starting its running sums one window before its first block. As
+// the sums of squares are kept in fixed point, a sum only depends on the samples of the window and
+// not on the way it was reached: the levels are the very ones of the sequential detector. The
+// silence transitions are then found by running the detector rule over the levels, which is cheap.
+class ParallelSilenceAnalysis
+{
+public:
+    // the samples [start, end) of the input that the sequential splitter writes to each tune
+    static Array<Range<int64>> findTunes(const File &input, AudioFormatManager &formatManager, ThreadPool &pool,
+                                         int windowSize, int blockSize, float threshold)
+    {
+        Array<Range<int64>> tunes;
+        std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(input));
+        if (reader == nullptr || reader->lengthInSamples == 0)
+        {
+            return tunes;
+        }
+
+        const int64 length = reader->lengthInSamples;
+        const int64 numBlocks = (length + blockSize - 1) / blockSize;
+        HeapBlock<float> levels((size_t)numBlocks, true);
+
+        // a few chunks per thread balances the load, a chunk much longer than its extra window keeps the overhead low
+        const int64 blocksPerChunk = jmax((numBlocks + pool.getNumThreads() * 4 - 1) / (pool.getNumThreads() * 4),
+                                          (int64)(4 * windowSize + blockSize - 1) / blockSize);
+        const int numChunks = (int)((numBlocks + blocksPerChunk - 1) / blocksPerChunk);
+
+        runInParallel(pool, numChunks, [&](int chunk) {
+            const int64 firstBlock = chunk * blocksPerChunk;
+            analyseBlocks(input, formatManager, firstBlock, jmin(firstBlock + blocksPerChunk, numBlocks),
+                          windowSize, blockSize, levels);
+        });
+
+        bool silence = true;
+        int64 tuneStart = 0;
+        for (int64 block = 0; block < numBlocks; ++block)
+        {
+            const int64 blockEnd = jmin((block + 1) * blockSize, length);
+            if (blockEnd < windowSize)
+            {
+                continue; // the detector window isn't full yet
+            }
+
+            switch (SilenceDetector::getEvent(silence, levels[block], threshold))
+            {
+            case SilenceDetector::Event::soundStarted:
+                // the tune starts with the window, and goes on with the blocks that follow
+                silence = false;
+                tuneStart = blockEnd - windowSize;
+                break;
+            case SilenceDetector::Event::silenceStarted:
+                // the block in which the silence is detected isn't written
+                silence = true;
+                tunes.add({tuneStart, block * blockSize});
+                break;
+            default:
+                break;
+            }
+        }
+        if (!silence)
+        {
+            tunes.add({tuneStart, length});
+        }
+        return tunes;
+    }
+
+    // runs task(0) ... task(numTasks - 1) on the pool and waits for all of them
+    static void runInParallel(ThreadPool &pool, int numTasks, const std::function<void(int)> &task)
+    {
+        if (numTasks <= 0)
+        {
+            return;
+        }
+
+        std::atomic<int> numRemainingTasks{numTasks};
+        WaitableEvent finished;
+        for (int i = 0; i < numTasks; i++)
+        {
+            pool.addJob([&, i] {
+                task(i);
+                if (--numRemainingTasks == 0)
+                {
+                    finished.signal();
+                }
+            });
+        }
+        finished.wait();
+    }
+
+private:
+    static constexpr int readSize = 1 << 16;
+
+    // the level of the window ending with each block of [firstBlock, endBlock)
+    static void analyseBlocks(const File &input, AudioFormatManager &formatManager, int64 firstBlock, int64 endBlock,
+                              int windowSize, int blockSize, float *levels)
+    {
+        std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(input));
+        if (reader == nullptr)
+        {
+            return;
+        }
+
+        const int numChannels = (int)reader->numChannels;
+        const int64 length = reader->lengthInSamples;
+        const int64 endSample = jmin(endBlock * blockSize, length);
+
+        // the squares of the window, as CircularBuffer keeps them; the samples before the file count as silence
+        HeapBlock<int64> squares((size_t)numChannels * (size_t)windowSize, true);
+        HeapBlock<int64> squareSums((size_t)numChannels, true);
+        int windowIndex = 0;
+
+        AudioBuffer<float> buffer(numChannels, readSize);
+        int64 position = jmax((int64)0, firstBlock * blockSize - windowSize);
+        int64 block = firstBlock;
+
+        while (position < endSample)
+        {
+            const int numRead = (int)jmin((int64)readSize, endSample - position);
+            reader->read(&buffer, 0, numRead, position, true, true);
+
+            int index = 0;
+            while (index < numRead)
+            {
+                // up to the end of the current block, or of what was read (the window before the first block is
+                // read as part of it)
+                const int64 blockEnd = jmin((block + 1) * blockSize, length);
+                const int numSamples = (int)jmin((int64)(numRead - index), blockEnd - (position + index));
+
+                for (int channel = 0; channel < numChannels; channel++)
+                {
+                    const float *samples = buffer.getReadPointer(channel, index);
+                    int64 *channelSquares = squares + (size_t)channel * (size_t)windowSize;
+                    int64 sum = squareSums[channel];
+                    int i = windowIndex;
+
+                    for (int j = 0; j < numSamples; j++)
+                    {
+                        const int64 square = CircularBuffer<float>::toFixedPointSquare(samples[j]);
+                        sum += square - channelSquares[i];
+                        channelSquares[i] = square;
+                        if (++i == windowSize)
+                        {
+                            i = 0;
+                        }
+                    }
+                    squareSums[channel] = sum;
+                }
+                windowIndex = (int)((windowIndex + numSamples) % windowSize);
+                index += numSamples;
+
+                if (position + index == blockEnd)
+                {
+                    levels[block++] = CircularBuffer<float>::toMeanRMSLevel(squareSums, numChannels, windowSize);
+                }
+            }
+            position += numRead;
+        }
+    }
+};
\ No newline at end of file
@@ -1,55 +1,269 @@
 #pragma once
 
 #include <JuceHeader.h>
-#include "AudioFileNormalizer.h"
-#include "AudioFileTrimmer.h"
+#include "AudioFileProcessingChain.h"
+#include "SessionJournal.h"
+#include "SpillingWriter.h"
+#include "TuneStatistics.h"
+#include "WavInPlaceGain.h"
+#include "WavInPlaceTrim.h"
 
-class PostRecordJob : ThreadPoolJob {
+class PostRecordJob {
 public:
-	PostRecordJob(File fileToTreat, bool normalize, bool trim, bool removechunks, AudioFormatManager* manager, float RMSThreshold, int chunkMaxSize)
-		: ThreadPoolJob(fileToTreat.getFileNameWithoutExtension()),
+	// with normalizeLoudness, normalize brings the integrated loudness to loudnessTarget instead of the peak to 0.99;
+	// the closing of the file and the treatments done go to the journal, when there's one
+	PostRecordJob(std::unique_ptr<SpillingWriter> writerToClose, File fileToTreat, TuneStatistics statistics, bool normalize, bool trim, bool removechunks, AudioFormatManager* manager, float RMSThreshold, int chunkMaxSize,
+	              bool normalizeLoudness = false, float loudnessTarget = defaultLoudnessTarget, SessionJournal::Ptr journal = nullptr)
+		: writerToClose(std::move(writerToClose)),
 		file(fileToTreat),
+        statistics(statistics),
         normalize(normalize),
         trim(trim),
         removechunks(removechunks),
         manager(manager),
         RMSThreshold(RMSThreshold),
-        chunkMaxSize(chunkMaxSize)
+        chunkMaxSize(chunkMaxSize),
+        normalizeLoudness(normalizeLoudness),
+        loudnessTarget(loudnessTarget),
+        journal(journal)
 	{
         
 	}
 
 	~PostRecordJob() { }
 
-	JobStatus runJob() override {
-        if (normalize)
+    static constexpr float defaultLoudnessTarget = -23.0f; // EBU R128
+    static constexpr float truePeakCeiling = 0.99f;         // the loudness gain never pushes the true peak above it
+
+    // with the format manager and the buffer of the worker, when it has some (see PostRecordScheduler);
+    // with nullptr, the format manager given to the constructor
+    void run(AudioFileProcessor::SharedResources *resources)
+    {
+        // flush the remaining recorded data and close the file before treating it
+        closeFile();
+
+        // a tune recorded without statistics gets them from a single read, whatever the treatments;
+        // they stay invalid when the file can't be read
+        const bool hasTreatments = normalize || trim || removechunks;
+        if (!statistics.isValid && hasTreatments)
+        {
+            statistics = analyse(resources != nullptr ? resources->formatManager : *manager);
+        }
+
+        const auto outcome = statistics.isValid ? processWithStatistics(resources) : hasTreatments ? Outcome::failed : Outcome::treated;
+        if (outcome == Outcome::failed)
         {
-            AudioFileNormalizer normalizer(file);
-            normalizer.process();
+            // the file is left as it was, and in the journal as not treated: the next session tries again
+            Logger::writeToLog(file.getFileName() + " couldn't be treated, it is left as recorded");
+            return;
         }
-        if (trim) {
-            AudioFileTrimer trimer(file, RMSThreshold);
-            trimer.process();
+
+        if (journal != nullptr && outcome == Outcome::removed)
+        {
+            journal->fileRemoved(file);
+        }
+        else if (journal != nullptr)
+        {
+            journal->fileTreated(file);
         }
-        if (removechunks) {
-            AudioFormatReader* reader = manager->createReaderFor(file);
-            if (reader->lengthInSamples < chunkMaxSize * reader->sampleRate) {
-                file.deleteFile();
-                delete reader;
+    }
+
+    // the first part of run(), on its own when the application quits: the treatment is left to the next session
+    void closeFile()
+    {
+        if (writerToClose != nullptr)
+        {
+            writerToClose->close();
+            if (auto *meter = writerToClose->getLoudnessMeter())
+            {
+                setLoudness(statistics, *meter);
             }
-            else
+            if (journal != nullptr)
             {
-                delete reader;
+                journal->fileClosed(file, writerToClose->getNumSamplesWritten());
             }
+            writerToClose.reset();
         }
-        return JobStatus::jobHasFinished;
-	}
+    }
+
+    const File &getFile() const
+    {
+        return file;
+    }
+
+    // the recorded file is still being flushed and closed by the job
+    bool hasWriterToClose() const
+    {
+        return writerToClose != nullptr;
+    }
+
+    static void setLoudness(TuneStatistics &statistics, const LoudnessMeter &meter)
+    {
+        const double loudness = meter.getIntegratedLoudness();
+        statistics.hasLoudness = loudness > LoudnessMeter::absoluteGate; // a silent tune has none
+        statistics.integratedLoudness = statistics.hasLoudness ? (float)loudness : 0.0f;
+        statistics.truePeak = meter.getTruePeak();
+    }
+
 private:
+    TuneStatistics analyse(AudioFormatManager &formatManager)
+    {
+        std::unique_ptr<AudioFormatReader> reader(formatManager.createReaderFor(file));
+        if (reader == nullptr)
+        {
+            return {};
+        }
+
+        TuneStatisticsAccumulator accumulator;
+        accumulator.reset(reader->sampleRate, RMSThreshold);
+        LoudnessMeter meter;
+        if (normalize && normalizeLoudness)
+        {
+            meter.reset(reader->sampleRate, (int)reader->numChannels);
+        }
+
+        AudioSampleBuffer block((int)reader->numChannels, AudioFileProcessor::getBlockSize(*reader, AudioFileProcessor::defaultBlockBytes));
+        for (int64 start = 0; start < reader->lengthInSamples; start += block.getNumSamples())
+        {
+            const int numSamples = (int)jmin((int64)block.getNumSamples(), reader->lengthInSamples - start);
+            if (!reader->read(&block, 0, numSamples, start, true, true))
+            {
+                return {};
+            }
+            accumulator.addBlock(block.getArrayOfReadPointers(), block.getNumChannels(), numSamples);
+            if (normalize && normalizeLoudness)
+            {
+                meter.addBlock(block.getArrayOfReadPointers(), numSamples);
+            }
+        }
+
+        auto result = accumulator.getStatistics();
+        if (normalize && normalizeLoudness)
+        {
+            setLoudness(result, meter);
+        }
+        return result;
+    }
+
+    enum class Outcome
+    {
+        treated,
+        removed,
+        failed // a pass couldn't read or write the file, which was kept
+    };
+
+    // everything is known from the capture: at most one read/write pass, none for chunks or untouched tunes
+    Outcome processWithStatistics(AudioFileProcessor::SharedResources *resources)
+    {
+        int64 startSample = 0;
+        int64 endSample = statistics.lengthInSamples;
+
+        if (trim && statistics.hasSound())
+        {
+            // let at least one silent sample on each side, like AudioFileTrimer
+            startSample = jmax((int64)0, statistics.firstSoundSample - 1);
+            endSample = jmin(statistics.lengthInSamples, statistics.lastSoundSample + 2);
+        }
+
+        // a tune without any sound is trimmed down to nothing
+        const int64 trimmedLength = trim && !statistics.hasSound() ? 0 : endSample - startSample;
+        if (removechunks && trimmedLength < chunkMaxSize * statistics.sampleRate)
+        {
+            file.deleteFile();
+            return Outcome::removed;
+        }
+
+        float gain = 1.0f;
+        if (normalize && normalizeLoudness)
+        {
+            if (statistics.hasLoudness)
+            {
+                gain = Decibels::decibelsToGain(loudnessTarget - statistics.integratedLoudness);
+                if (statistics.truePeak > 0)
+                {
+                    gain = jmin(gain, truePeakCeiling / statistics.truePeak);
+                }
+                DBG(file.getFileName() << ": " << statistics.integratedLoudness << " LUFS, true peak "
+                                       << Decibels::gainToDecibels(statistics.truePeak) << " dBTP, gain " << Decibels::gainToDecibels(gain) << " dB");
+            }
+            if (std::abs(Decibels::gainToDecibels(gain)) < 0.01f)
+            {
+                gain = 1.0f; // not worth a pass
+            }
+        }
+        else if (normalize && statistics.peak > 0)
+        {
+            gain = 0.99f / statistics.peak;
+            if (std::abs(Decibels::gainToDecibels(gain)) < 0.01f)
+            {
+                gain = 1.0f; // not worth a pass
+            }
+        }
+
+        bool needsTrim = startSample > 0 || endSample < statistics.lengthInSamples;
+
+        // WAV files are trimmed by rewriting their header, then get their gain in place: no processed copy
+        if (file.hasFileExtension("wav"))
+        {
+            if (needsTrim)
+            {
+                auto trimResult = WavInPlaceTrim::apply(file, startSample, endSample - startSample);
+                if (trimResult.wasTrimmed)
+                {
+                    // what the trim cost, against the size of the copy it saves
+                    stageDone("trimmed in place, " + String(trimResult.bytesWritten) + " bytes written");
+                    needsTrim = false;
+                    startSample = 0;
+                    endSample = trimResult.numFrames;
+                }
+            }
+            if (gain != 1.0f && WavInPlaceGain::apply(file, gain))
+            {
+                stageDone("gain in place");
+                gain = 1.0f;
+            }
+        }
+
+        // the other treatments are stages of a single pass
+        if (gain != 1.0f || needsTrim)
+        {
+            AudioFileProcessingChain chain(file, resources);
+            chain.setWindow(startSample, endSample - startSample);
+            if (gain != 1.0f)
+            {
+                chain.addStage(new GainStage(gain));
+                if (chain.getBitsPerSample() > 0 && chain.getBitsPerSample() <= 16)
+                {
+                    chain.addStage(new DitherStage(chain.getBitsPerSample()));
+                }
+            }
+            if (!chain.process())
+            {
+                return Outcome::failed;
+            }
+            stageDone("processed"); // the copy replaced the file
+        }
+        return Outcome::treated;
+    }
+
+    void stageDone(const String &stage)
+    {
+        if (journal != nullptr)
+        {
+            journal->stageDone(file, stage);
+        }
+    }
+
+    std::unique_ptr<SpillingWriter> writerToClose;
     AudioFormatManager* manager;
 	File file;
+    TuneStatistics statistics;
     bool normalize, trim, removechunks;
     float RMSThreshold;
     int chunkMaxSize;
+    bool normalizeLoudness;
+    float loudnessTarget;
+    SessionJournal::Ptr journal;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PostRecordJob);
 };
\ No newline at end of file
@@ -0,0 +1,356 @@
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <JuceHeader.h>
+#include "PostRecordJob.h"
+
+#if ! JUCE_WINDOWS
+ #include <sys/stat.h>
+#endif
+
+// Runs the post-record treatments of all the recorders, within limits: a fixed number of workers,
+// each with its own format manager and buffer; and at most a few treatments reading and writing the
+// same disk at once. Adding a job never waits, it comes from the thread rotating the files: once
+// maxQueuedJobs are waiting, the treatments don't keep up with the tunes, and the new ones are left to
+// the next session (see SessionJournal), their file only gets closed.
+//
+// Closing a recorded file goes first, whatever the disk limit: its spill buffer holds memory and the
+// file isn't complete on the disk. Its treatment is then queued again, like any other, and the
+// treatments are taken oldest or newest tune first.
+class PostRecordScheduler
+{
+public:
+    struct Options
+    {
+        int numWorkers = 2;
+        int maxQueuedJobs = 32; // beyond it, the treatments are left to the next session
+        int maxJobsPerDisk = 1;
+        bool newestFirst = false;
+        int blockBytes = AudioFileProcessor::defaultBlockBytes; // read and written at once by the treatments
+    };
+
+    PostRecordScheduler()
+    {
+        setOptions(Options());
+    }
+
+    // The jobs already running are finished, the recorded files still to close are closed, but the
+    // treatments that haven't started are dropped: the next session finds them in the journal of their
+    // folder (see SessionJournal). Quitting doesn't wait for a backlog of treatments.
+    ~PostRecordScheduler()
+    {
+        std::vector<Entry> dropped;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finishingAll = true;
+            dropQueuedTreatments(dropped);
+            jobsChanged.wait(lock, [this] { return queue.empty() && numRunningJobs == 0; });
+        }
+        setNumWorkers(0);
+    }
+
+    void setOptions(const Options &newOptions)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            options = newOptions;
+            options.maxQueuedJobs = jmax(1, options.maxQueuedJobs);
+            options.maxJobsPerDisk = jmax(1, options.maxJobsPerDisk);
+            options.blockBytes = jmax(1 << 12, options.blockBytes);
+        }
+        jobsChanged.notify_all();
+        setNumWorkers(jmax(1, newOptions.numWorkers));
+    }
+
+    void addJob(std::unique_ptr<PostRecordJob> job, const void *owner)
+    {
+        Entry entry;
+        entry.owner = owner;
+        entry.disk = getDiskOf(job->getFile());
+        entry.closesFile = job->hasWriterToClose();
+        entry.job = std::move(job);
+        add(std::move(entry));
+    }
+
+    // a task, for the recovery of interrupted treatments; it has the priority of a treatment, the
+    // jobs closing a file still go first
+    void addTask(const File &folder, std::function<void()> task, const void *owner)
+    {
+        Entry entry;
+        entry.owner = owner;
+        entry.disk = getDiskOf(folder.getChildFile("task"));
+        entry.task = std::move(task);
+        add(std::move(entry));
+    }
+
+    // The jobs closing the files of a recorder use its writer thread and its buffers: before it goes,
+    // its files are closed and its running jobs finished. Its treatments that haven't started are
+    // dropped, like when the scheduler goes.
+    void finishJobsOf(const void *owner)
+    {
+        std::vector<Entry> dropped;
+        std::unique_lock<std::mutex> lock(mutex);
+        finishingOwners.insert(owner);
+        dropQueuedTreatments(dropped);
+        jobsChanged.wait(lock, [this, owner] { return numJobsPerOwner[owner] == 0; });
+        finishingOwners.erase(owner);
+        numJobsPerOwner.erase(owner);
+    }
+
+    int getNumQueuedJobs()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (int)queue.size();
+    }
+
+private:
+    struct Entry
+    {
+        std::unique_ptr<PostRecordJob> job;
+        std::function<void()> task;
+        const void *owner = nullptr;
+        String disk;
+        bool closesFile = false;
+        bool closeOnly = false; // the file is closed, its treatment left to the next session
+        int64 sequence = 0;
+        int blockBytes = AudioFileProcessor::defaultBlockBytes; // of the options when the job starts
+    };
+
+    class Worker : public Thread
+    {
+    public:
+        Worker(PostRecordScheduler &scheduler)
+            : Thread("Post-record worker"),
+              scheduler(scheduler)
+        {
+        }
+
+        void run() override
+        {
+            Entry entry;
+            while (scheduler.takeNextJob(*this, entry))
+            {
+                resources.blockBytes = entry.blockBytes;
+                if (entry.closesFile)
+                {
+                    entry.job->closeFile();
+                    scheduler.fileClosed(entry);
+                    continue;
+                }
+
+                if (entry.job != nullptr)
+                    entry.job->run(&resources);
+                else
+                    entry.task();
+
+                entry.job.reset(); // before the disk is released
+                scheduler.jobFinished(entry);
+            }
+        }
+
+    private:
+        PostRecordScheduler &scheduler;
+        AudioFileProcessor::SharedResources resources;
+    };
+
+    std::mutex mutex;
+    std::condition_variable jobsChanged;
+    Options options;
+    std::vector<Entry> queue; // the entries own their job, they can only be moved
+    HashMap<String, int> numJobsPerDisk;            // running
+    std::map<const void *, int> numJobsPerOwner;     // queued or running
+    int numRunningJobs = 0;
+    int64 nextSequence = 0;
+    std::set<const void *> finishingOwners; // their treatments are dropped
+    bool finishingAll = false;
+    bool backlogLogged = false; // until the queue is back under its length
+    OwnedArray<Worker> workers;
+
+    void add(Entry entry)
+    {
+        int queueLength = 0;
+        bool logBacklog = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queueLength = (int)queue.size();
+            const bool isBacklogged = queueLength >= options.maxQueuedJobs;
+            if (isFinishing(entry) || isBacklogged)
+            {
+                logBacklog = isBacklogged && !isFinishing(entry) && !backlogLogged;
+                backlogLogged = backlogLogged || logBacklog;
+                if (!entry.closesFile)
+                {
+                    return; // a recovery still running adds them, they are left to the next session
+                }
+                entry.closeOnly = true;
+            }
+            entry.sequence = nextSequence++;
+            ++numJobsPerOwner[entry.owner];
+            queue.push_back(std::move(entry));
+        }
+        jobsChanged.notify_all();
+
+        if (logBacklog)
+        {
+            Logger::writeToLog(String(queueLength) + " post-record jobs are waiting, they don't keep up with the recording: "
+                               "the next treatments are left to the next session");
+        }
+    }
+
+    bool isFinishing(const Entry &entry) const
+    {
+        return finishingAll || finishingOwners.count(entry.owner) > 0;
+    }
+
+    // with the lock held: the queued jobs of the owners being finished only close their file, the other
+    // ones are moved out of the queue, to the caller, who deletes them once the lock is released
+    void dropQueuedTreatments(std::vector<Entry> &dropped)
+    {
+        for (size_t i = 0; i < queue.size();)
+        {
+            if (!isFinishing(queue[i]))
+            {
+                i++;
+            }
+            else if (queue[i].closesFile)
+            {
+                queue[i].closeOnly = true;
+                i++;
+            }
+            else
+            {
+                --numJobsPerOwner[queue[i].owner];
+                dropped.push_back(std::move(queue[i]));
+                queue.erase(queue.begin() + (std::ptrdiff_t)i);
+            }
+        }
+    }
+
+    // worker thread: waits for a job it is allowed to run, returns false once it should stop
+    bool takeNextJob(Worker &worker, Entry &entry)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        int index = -1;
+        jobsChanged.wait(lock, [&] {
+            index = findNextJob();
+            return worker.threadShouldExit() || index >= 0;
+        });
+        if (worker.threadShouldExit())
+        {
+            return false;
+        }
+
+        entry = std::move(queue[(size_t)index]);
+        queue.erase(queue.begin() + index);
+        entry.blockBytes = options.blockBytes;
+        numJobsPerDisk.set(entry.disk, numJobsPerDisk[entry.disk] + 1);
+        ++numRunningJobs;
+        backlogLogged = backlogLogged && (int)queue.size() >= options.maxQueuedJobs;
+        return true;
+    }
+
+    // worker thread: the file of the entry is complete, its treatment waits for its turn on the disk,
+    // unless it is left to the next session
+    void fileClosed(Entry &entry)
+    {
+        bool drop = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            numJobsPerDisk.set(entry.disk, numJobsPerDisk[entry.disk] - 1);
+            --numRunningJobs;
+            entry.closesFile = false;
+            drop = entry.closeOnly || isFinishing(entry);
+            if (drop)
+            {
+                --numJobsPerOwner[entry.owner];
+            }
+            else
+            {
+                queue.push_back(std::move(entry)); // with its sequence: it keeps the age of its tune
+            }
+        }
+        entry.job.reset();
+        jobsChanged.notify_all();
+    }
+
+    void jobFinished(const Entry &entry)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            numJobsPerDisk.set(entry.disk, numJobsPerDisk[entry.disk] - 1);
+            --numJobsPerOwner[entry.owner];
+            --numRunningJobs;
+        }
+        jobsChanged.notify_all();
+    }
+
+    // the most urgent job that can run, -1 when there's none: closing a file only flushes its spill
+    // buffer, it doesn't wait for a long treatment of the same disk
+    int findNextJob() const
+    {
+        int best = -1;
+        for (int i = 0; i < (int)queue.size(); i++)
+        {
+            auto &entry = queue[(size_t)i];
+            if (!entry.closesFile && numJobsPerDisk[entry.disk] >= options.maxJobsPerDisk)
+            {
+                continue;
+            }
+            if (best < 0 || isMoreUrgent(entry, queue[(size_t)best]))
+            {
+                best = i;
+            }
+        }
+        return best;
+    }
+
+    bool isMoreUrgent(const Entry &entry, const Entry &other) const
+    {
+        if (entry.closesFile != other.closesFile)
+        {
+            return entry.closesFile;
+        }
+        return options.newestFirst ? entry.sequence > other.sequence : entry.sequence < other.sequence;
+    }
+
+    void setNumWorkers(int numWorkers)
+    {
+        while (workers.size() < numWorkers)
+        {
+            workers.add(new Worker(*this))->startThread();
+        }
+        while (workers.size() > numWorkers)
+        {
+            // a worker finishes the job it is running first
+            auto *worker = workers.getLast();
+            worker->signalThreadShouldExit();
+            {
+                std::lock_guard<std::mutex> lock(mutex); // so that the worker can't miss the notification
+            }
+            jobsChanged.notify_all();
+            worker->stopThread(-1);
+            workers.removeLast();
+        }
+    }
+
+    // the jobs writing to the same device share its limit
+    static String getDiskOf(const File &file)
+    {
+       #if JUCE_WINDOWS
+        return String(file.getVolumeSerialNumber());
+       #else
+        struct stat info;
+        if (stat(file.getParentDirectory().getFullPathName().toRawUTF8(), &info) == 0)
+        {
+            return String((int64)info.st_dev);
+        }
+        return {};
+       #endif
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PostRecordScheduler)
+};
\ No newline at end of file
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <JuceHeader.h>
+
+// Debug/test mode that catches heap use on the audio thread.
+// Build with COLLECTIONRECORDER_CHECK_RT_ALLOCATIONS=1 (e.g. make CPPFLAGS=-DCOLLECTIONRECORDER_CHECK_RT_ALLOCATIONS=1)
+// to replace the global operator new/delete (and their aligned forms, with C++17), and malloc/calloc/realloc/free
+// when linking against glibc. The replay harness always is.
+// Any of them called while a ScopedRealtimeSection is alive on the calling thread is counted and
+// asserts, and aborts the process when setAbortOnAllocation(true) has been called.
+// The replacement functions are defined in this header: only one translation unit per executable
+// may include it, which is the case as each of our executables is built from a single source file.
+#ifndef COLLECTIONRECORDER_CHECK_RT_ALLOCATIONS
+ #define COLLECTIONRECORDER_CHECK_RT_ALLOCATIONS 0
+#endif
+
+class RealtimeAllocationChecker
+{
+public:
+    // marks the calling thread as real-time for the lifetime of the object, free when the check is disabled
+    struct ScopedRealtimeSection
+    {
+       #if COLLECTIONRECORDER_CHECK_RT_ALLOCATIONS
+        ScopedRealtimeSection() noexcept : wasInSection(isInRealtimeSection())
+        {
+            isInRealtimeSection() = true;
+        }
+
+        ~ScopedRealtimeSection() noexcept
+        {
+            isInRealtimeSection() = wasInSection;
+        }
+
+        const bool wasInSection;
+       #endif
+    };
+
+    static int64 getNumRealtimeHeapCalls() noexcept
+    {
+        return heapCallCount().load();
+    }
+
+    static void setAbortOnAllocation(bool shouldAbort) noexcept
+    {
+        abortOnAllocation().store(shouldAbort);
+    }
+
+    static void checkHeapCall() noexcept
+    {
+        if (isInRealtimeSection())
+        {
+            // leave the section while reporting, the assertion logging allocates itself
+            isInRealtimeSection() = false;
+            ++heapCallCount();
+
+            if (abortOnAllocation().load())
+            {
+                std::abort();
+            }
+            jassertfalse; // the audio thread called the heap
+
+            isInRealtimeSection() = true;
+        }
+    }
+
+private:
+    static bool& isInRealtimeSection() noexcept
+    {
+        static thread_local bool inSection = false;
+        return inSection;
+    }
+
+    static std::atomic<int64>& heapCallCount() noexcept
+    {
+        static std::atomic<int64> count{0};
+        return count;
+    }
+
+    static std::atomic<bool>& abortOnAllocation() noexcept
+    {
+        static std::atomic<bool> shouldAbort{false};
+        return shouldAbort;
+    }
+};
+
+#if COLLECTIONRECORDER_CHECK_RT_ALLOCATIONS
+ #if JUCE_LINUX && defined(__GLIBC__)
+  #define COLLECTIONRECORDER_HOOKS_MALLOC 1
+
+extern "C"
+{
+    void *__libc_malloc(size_t);
+    void *__libc_calloc(size_t, size_t);
+    void *__libc_realloc(void *, size_t);
+    void __libc_free(void *);
+
+    void *malloc(size_t size) noexcept
+    {
+        RealtimeAllocationChecker::checkHeapCall();
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t num, size_t size) noexcept
+    {
+        RealtimeAllocationChecker::checkHeapCall();
+        return __libc_calloc(num, size);
+    }
+
+    void *realloc(void *ptr, size_t size) noexcept
+    {
+        RealtimeAllocationChecker::checkHeapCall();
+        return __libc_realloc(ptr, size);
+    }
+
+    void free(void *ptr) noexcept
+    {
+        if (ptr != nullptr)
+        {
+            RealtimeAllocationChecker::checkHeapCall();
+        }
+        __libc_free(ptr);
+    }
+}
+ #else
+  #define COLLECTIONRECORDER_HOOKS_MALLOC 0
+ #endif
+
+void *operator new(std::size_t size)
+{
+   #if ! COLLECTIONRECORDER_HOOKS_MALLOC
+    RealtimeAllocationChecker::checkHeapCall(); // otherwise counted by malloc
+   #endif
+    if (auto *ptr = std::malloc(size == 0 ? 1 : size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+   #if ! COLLECTIONRECORDER_HOOKS_MALLOC
+    if (ptr != nullptr)
+    {
+        RealtimeAllocationChecker::checkHeapCall();
+    }
+   #endif
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+ #if __cpp_aligned_new
+void *operator new(std::size_t size, std::align_val_t alignment)
+{
+    RealtimeAllocationChecker::checkHeapCall(); // the aligned allocation functions aren't hooked
+    const std::size_t align = jmax(sizeof(void *), (std::size_t)alignment);
+   #if JUCE_WINDOWS
+    if (auto *ptr = _aligned_malloc(size == 0 ? 1 : size, align))
+    {
+        return ptr;
+    }
+   #else
+    void *ptr = nullptr;
+    if (posix_memalign(&ptr, align, size == 0 ? 1 : size) == 0)
+    {
+        return ptr;
+    }
+   #endif
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+   #if JUCE_WINDOWS || ! COLLECTIONRECORDER_HOOKS_MALLOC
+    if (ptr != nullptr)
+    {
+        RealtimeAllocationChecker::checkHeapCall();
+    }
+   #endif
+   #if JUCE_WINDOWS
+    _aligned_free(ptr);
+   #else
+    std::free(ptr);
+   #endif
+}
+
+void operator delete[](void *ptr, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t alignment) noexcept
+{
+    operator delete(ptr, alignment);
+}
+ #endif
+#endif
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <atomic>
+#include <JuceHeader.h>
+
+#if JUCE_WINDOWS
+ #ifndef WIN32_LEAN_AND_MEAN
+  #define WIN32_LEAN_AND_MEAN
+ #endif
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #include <windows.h>
+#else
+ #include <cerrno>
+ #include <ctime>
+ #include <semaphore.h>
+#endif
+
+// What the audio callback tells the rest of the recorder
+struct RecorderEvent
+{
+    enum class Type
+    {
+        silenceStarted, // a tune ended
+        soundStarted,   // a tune started
+        clipStarted,
+        clipEnded,      // raised by the control thread, a moment after the last clipping block
+        overflow        // the spill buffer is full, samples are being dropped
+    };
+
+    Type type = Type::silenceStarted;
+    int64 samplePosition = 0; // of the block, counted since the device started
+};
+
+// Single producer, single consumer FIFO of events: the audio thread pushes without locking or
+// allocating, one other thread pops. An event that doesn't fit is counted instead of waited for.
+class RecorderEventQueue
+{
+public:
+    explicit RecorderEventQueue(int capacity = 256)
+        : fifo(capacity + 1) // an AbstractFifo keeps one slot free
+    {
+        events.calloc((size_t)capacity + 1);
+    }
+
+    bool push(const RecorderEvent &event) noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(1, start1, size1, start2, size2);
+        if (size1 + size2 == 0)
+        {
+            numLostEvents.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        events[size1 > 0 ? start1 : start2] = event;
+        fifo.finishedWrite(1);
+        return true;
+    }
+
+    bool pop(RecorderEvent &event) noexcept
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(1, start1, size1, start2, size2);
+        if (size1 + size2 == 0)
+        {
+            return false;
+        }
+
+        event = events[size1 > 0 ? start1 : start2];
+        fifo.finishedRead(1);
+        return true;
+    }
+
+    int64 getNumLostEvents() const noexcept
+    {
+        return numLostEvents.load(std::memory_order_relaxed);
+    }
+
+private:
+    AbstractFifo fifo;
+    HeapBlock<RecorderEvent> events;
+    std::atomic<int64> numLostEvents{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RecorderEventQueue)
+};
+
+// A counting semaphore of the system, that the audio thread can signal: posting a semaphore doesn't
+// take a lock (a futex on Linux), unlike signalling a WaitableEvent, whose mutex the waiting thread may hold.
+class RealtimeSemaphore
+{
+public:
+    RealtimeSemaphore()
+    {
+       #if JUCE_WINDOWS
+        handle = CreateSemaphoreW(nullptr, 0, 0x7fffffff, nullptr);
+       #else
+        sem_init(&semaphore, 0, 0);
+       #endif
+    }
+
+    ~RealtimeSemaphore()
+    {
+       #if JUCE_WINDOWS
+        CloseHandle(handle);
+       #else
+        sem_destroy(&semaphore);
+       #endif
+    }
+
+    // any thread, the audio one included
+    void signal() noexcept
+    {
+       #if JUCE_WINDOWS
+        ReleaseSemaphore(handle, 1, nullptr);
+       #else
+        sem_post(&semaphore);
+       #endif
+    }
+
+    // false when the timeout elapsed first; -1 waits as long as it takes
+    bool wait(int timeoutMilliseconds) noexcept
+    {
+       #if JUCE_WINDOWS
+        return WaitForSingleObject(handle, timeoutMilliseconds < 0 ? INFINITE : (DWORD)timeoutMilliseconds) == WAIT_OBJECT_0;
+       #else
+        if (timeoutMilliseconds < 0)
+        {
+            while (sem_wait(&semaphore) != 0)
+            {
+                if (errno != EINTR)
+                    return false;
+            }
+            return true;
+        }
+
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeoutMilliseconds / 1000;
+        deadline.tv_nsec += (long)(timeoutMilliseconds % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while (sem_timedwait(&semaphore, &deadline) != 0)
+        {
+            if (errno != EINTR)
+                return false;
+        }
+        return true;
+       #endif
+    }
+
+    // takes the signals already there, without waiting
+    void drain() noexcept
+    {
+        while (wait(0))
+        {
+        }
+    }
+
+private:
+   #if JUCE_WINDOWS
+    HANDLE handle;
+   #else
+    sem_t semaphore;
+   #endif
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RealtimeSemaphore)
+};
+
+// The thread that acts on the events of the audio callback. It sleeps until one is posted, or until
+// the time its client asked for, so nothing polls while the recording runs. The audio thread wakes it
+// through a RealtimeSemaphore, which never makes it wait.
+class RecorderControlThread : private Thread
+{
+public:
+    class Client
+    {
+    public:
+        virtual ~Client() = default;
+
+        virtual void handleEvent(const RecorderEvent &event) = 0;
+
+        // after the events of each wake up; returns the milliseconds until the next call, or -1 to sleep until an event
+        virtual int handleIdle() = 0;
+    };
+
+    RecorderControlThread(Client &client)
+        : Thread("Recorder control"),
+          client(client)
+    {
+    }
+
+    ~RecorderControlThread() override
+    {
+        stop();
+    }
+
+    void start()
+    {
+        startThread();
+    }
+
+    void stop()
+    {
+        signalThreadShouldExit();
+        wakeUps.signal();
+        stopThread(-1);
+    }
+
+    // audio thread: lock-free, like the wake up
+    void post(const RecorderEvent &event) noexcept
+    {
+        queue.push(event);
+        wakeUp();
+    }
+
+    // runs handleIdle() soon, from any thread
+    void wakeUp() noexcept
+    {
+        numWakeUps.fetch_add(1);
+        wakeUps.signal();
+    }
+
+    // returns once the events posted so far have been handled; not on the audio or the control thread
+    void waitUntilHandled()
+    {
+        const uint32 target = numWakeUps.load();
+        while (isThreadRunning() && (int32)(numHandledWakeUps.load() - target) < 0)
+        {
+            handled.wait(10);
+        }
+    }
+
+    int64 getNumLostEvents() const noexcept
+    {
+        return queue.getNumLostEvents();
+    }
+
+private:
+    Client &client;
+    RecorderEventQueue queue;
+    std::atomic<uint32> numWakeUps{0};
+    std::atomic<uint32> numHandledWakeUps{0};
+    RealtimeSemaphore wakeUps;
+    WaitableEvent handled;
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            // the signals so far are all covered by this pass: the events posted before the load are popped below
+            wakeUps.drain();
+            const uint32 numWakeUpsToHandle = numWakeUps.load();
+
+            RecorderEvent event;
+            while (queue.pop(event))
+            {
+                client.handleEvent(event);
+            }
+            const int timeout = client.handleIdle();
+
+            numHandledWakeUps = numWakeUpsToHandle;
+            handled.signal();
+            wakeUps.wait(timeout);
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RecorderControlThread)
+};
\ No newline at end of file
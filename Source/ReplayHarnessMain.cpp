@@ -0,0 +1,478 @@
+/*
+  ==============================================================================
+
+    Console entry point of CollectionReplayHarness: plays a file or a synthetic
+    session through AudioRecorder on a virtual audio device, faster than real
+    time, then checks where the tunes were split and what was lost.
+
+  ==============================================================================
+*/
+
+// the harness always counts the heap calls of the audio callbacks, whatever the build flags
+#undef COLLECTIONRECORDER_CHECK_RT_ALLOCATIONS
+#define COLLECTIONRECORDER_CHECK_RT_ALLOCATIONS 1
+
+#include <iostream>
+#include <JuceHeader.h>
+#include "AudioRecorder.h"
+#include "VirtualAudioDevice.h"
+
+// A session of tunes separated by silences, with known boundaries. The tunes are a square wave,
+// every sample of which is clearly above the silence level, so that the sound samples of the
+// recorded files can be counted exactly; the silences are a faint noise.
+class SyntheticSession
+{
+public:
+    struct Tune
+    {
+        int64 start = 0;
+        int64 numSamples = 0;
+    };
+
+    SyntheticSession(double sampleRate, double durationSeconds, double silenceSeconds,
+                     double minTuneSeconds, double maxTuneSeconds, int64 seed)
+    {
+        Random random(seed);
+        const int64 length = (int64)(durationSeconds * sampleRate);
+        int64 position = (int64)(silenceSeconds * sampleRate);
+
+        while (true)
+        {
+            Tune tune;
+            tune.start = position;
+            tune.numSamples = (int64)((minTuneSeconds + random.nextDouble() * (maxTuneSeconds - minTuneSeconds)) * sampleRate);
+            if (tune.start + tune.numSamples > length)
+            {
+                break;
+            }
+            tunes.add(tune);
+            // long enough for the silence to be detected
+            position += tune.numSamples + (int64)((1.5 + random.nextDouble()) * silenceSeconds * sampleRate);
+        }
+        totalLength = length;
+    }
+
+    bool fill(AudioBuffer<float> &block)
+    {
+        if (position >= totalLength)
+        {
+            return false;
+        }
+
+        for (int i = 0; i < block.getNumSamples(); i++, position++)
+        {
+            while (currentTune < tunes.size() && position >= tunes[currentTune].start + tunes[currentTune].numSamples)
+            {
+                ++currentTune;
+            }
+            const bool isSound = currentTune < tunes.size() && position >= tunes[currentTune].start;
+            for (int channel = 0; channel < block.getNumChannels(); channel++)
+            {
+                block.setSample(channel, i, isSound ? ((position / 50) % 2 == 0 ? soundLevel : -soundLevel)
+                                                    : 0.0002f * (noise.nextFloat() - 0.5f));
+            }
+        }
+        return true;
+    }
+
+    const Array<Tune> &getTunes() const noexcept
+    {
+        return tunes;
+    }
+
+    static bool isSound(float sample) noexcept
+    {
+        return std::abs(sample) > soundLevel / 2;
+    }
+
+private:
+    static constexpr float soundLevel = 0.5f;
+    Array<Tune> tunes;
+    int64 totalLength = 0;
+    int64 position = 0;
+    int currentTune = 0;
+    Random noise{42};
+};
+
+struct RecordedFile
+{
+    File file;
+    int64 numSamples = 0;
+    int64 numSoundSamples = 0;
+};
+
+static int getTuneNumber(const File &file)
+{
+    // "Tune .wav" is the first one, then "Tune 2.wav"...
+    return jmax(1, file.getFileNameWithoutExtension().getTrailingIntValue());
+}
+
+static Array<RecordedFile> readRecordedFiles(const File &folder, AudioFormatManager &formatManager)
+{
+    auto files = folder.findChildFiles(File::findFiles, false, "Tune*");
+    std::sort(files.begin(), files.end(), [](const File &a, const File &b) { return getTuneNumber(a) < getTuneNumber(b); });
+
+    Array<RecordedFile> recordedFiles;
+    for (auto &file : files)
+    {
+        RecordedFile recordedFile;
+        recordedFile.file = file;
+        if (std::unique_ptr<AudioFormatReader> reader{formatManager.createReaderFor(file)})
+        {
+            recordedFile.numSamples = reader->lengthInSamples;
+            AudioBuffer<float> buffer((int)reader->numChannels, 1 << 16);
+            for (int64 position = 0; position < reader->lengthInSamples; position += buffer.getNumSamples())
+            {
+                const int numSamples = (int)jmin((int64)buffer.getNumSamples(), reader->lengthInSamples - position);
+                reader->read(&buffer, 0, numSamples, position, true, true);
+                for (int i = 0; i < numSamples; i++)
+                {
+                    if (SyntheticSession::isSound(buffer.getSample(0, i)))
+                    {
+                        ++recordedFile.numSoundSamples;
+                    }
+                }
+            }
+        }
+        recordedFiles.add(recordedFile);
+    }
+    return recordedFiles;
+}
+
+// Forces splits back to back while the device plays freely: each one swaps or creates a writer under
+// the rotation lock, and releases the previous one, while callbacks keep running on the device thread.
+class SplitStressThread : public Thread
+{
+public:
+    SplitStressThread(AudioRecorder &recorder, int numSplits)
+        : Thread("Split stress"),
+          recorder(recorder),
+          numSplits(numSplits)
+    {
+    }
+
+    ~SplitStressThread() override
+    {
+        stopThread(-1);
+    }
+
+    int getNumForcedSplits() const noexcept
+    {
+        return numForcedSplits;
+    }
+
+private:
+    void run() override
+    {
+        while (!threadShouldExit() && numForcedSplits < numSplits)
+        {
+            recorder.shouldRestart = true;
+            recorder.handlePendingRestart();
+            ++numForcedSplits;
+            Thread::yield();
+        }
+    }
+
+    AudioRecorder &recorder;
+    const int numSplits;
+    std::atomic<int> numForcedSplits{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SplitStressThread)
+};
+
+static var profileToVar(const CallbackProfiler::Snapshot &profile)
+{
+    auto *profileObject = new DynamicObject();
+    profileObject->setProperty("deadlineSeconds", profile.deadlineSeconds);
+    profileObject->setProperty("numNearMisses", (int64)profile.numNearMisses);
+    profileObject->setProperty("numOverruns", (int64)profile.numOverruns);
+
+    Array<var> bucketLimits;
+    for (int i = 0; i < CallbackProfiler::numBuckets - 1; i++)
+    {
+        bucketLimits.add(CallbackProfiler::getBucketUpperFraction(i));
+    }
+    profileObject->setProperty("bucketUpperFractions", bucketLimits);
+
+    for (int phase = 0; phase < CallbackProfiler::numPhases; phase++)
+    {
+        auto &phaseProfile = profile.phases[phase];
+        auto *phaseObject = new DynamicObject();
+        phaseObject->setProperty("count", (int64)phaseProfile.count);
+        phaseObject->setProperty("meanFraction", phaseProfile.meanFraction);
+        phaseObject->setProperty("maxFraction", phaseProfile.maxFraction);
+        Array<var> buckets;
+        for (auto count : phaseProfile.buckets)
+        {
+            buckets.add((int64)count);
+        }
+        phaseObject->setProperty("buckets", buckets);
+        profileObject->setProperty(CallbackProfiler::getPhaseName(phase), var(phaseObject));
+    }
+    return var(profileObject);
+}
+
+static void printUsage()
+{
+    std::cout << "Usage: CollectionReplayHarness [options] [file]" << std::endl
+              << "  without a file, a synthetic session of tunes with known boundaries is played" << std::endl
+              << "  --duration=<s>             length of the synthetic session (default: 3600)" << std::endl
+              << "  --tune-length=<min>,<max>  length of the synthetic tunes in seconds (default: 5,120)" << std::endl
+              << "  --seed=<n>                 of the synthetic session (default: 1)" << std::endl
+              << "  --sample-rate=<hz>         (default: 48000, or the one of the file)" << std::endl
+              << "  --buffer-size=<samples>    (default: 512)" << std::endl
+              << "  --channels=<n>             (default: 2, or the ones of the file)" << std::endl
+              << "  --speed=<x>                times real time, 0 for as fast as possible (default: 0)" << std::endl
+              << "  --free-running             don't wait for the control thread every 10 ms of audio, as in the application" << std::endl
+              << "  --forced-split=<ms>        also split every given time of audio, the writer swap stress test" << std::endl
+              << "  --stress-splits=<n>        free running, a second thread forces n splits back to back while the callbacks run;" << std::endl
+              << "                             the sound lost while a writer is replaced isn't checked, the callback durations are" << std::endl
+              << "  --max-callback=<fraction>  of the block duration a callback may take, more means it waited (default: 1)" << std::endl
+              << "  --format=wav|flac          (default: wav)" << std::endl
+              << "  --spill=<seconds>          spill buffer ahead of the disk (default: 30)" << std::endl
+              << "  --no-prepared-writer       create each file when the previous one ends, the split latency reference" << std::endl
+              << "  --threshold=<rms>          (default: 0.01)" << std::endl
+              << "  --silence=<seconds>        (default: 2)" << std::endl
+              << "  --output=<folder>          recorded files (default: a temporary folder, deleted at the end)" << std::endl
+              << "  --report=<file>            JSON report" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    ArgumentList args(argc, argv);
+    if (args.containsOption("--help|-h"))
+    {
+        printUsage();
+        return 0;
+    }
+
+    // the message thread is this one, the audio runs on the virtual device thread
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    File inputFile;
+    for (auto &argument : args.arguments)
+    {
+        if (!argument.isOption())
+        {
+            inputFile = argument.resolveAsFile();
+        }
+    }
+
+    std::unique_ptr<AudioFormatReader> inputReader;
+    if (inputFile != File())
+    {
+        inputReader.reset(formatManager.createReaderFor(inputFile));
+        if (inputReader == nullptr)
+        {
+            std::cerr << inputFile.getFullPathName() << ": can't be read" << std::endl;
+            return 1;
+        }
+    }
+
+    const double sampleRate = inputReader != nullptr ? inputReader->sampleRate
+                                                     : (args.containsOption("--sample-rate") ? args.getValueForOption("--sample-rate").getDoubleValue() : 48000.0);
+    const int numChannels = inputReader != nullptr ? (int)inputReader->numChannels
+                                                   : (args.containsOption("--channels") ? jmax(1, args.getValueForOption("--channels").getIntValue()) : 2);
+    const int bufferSize = args.containsOption("--buffer-size") ? jmax(1, args.getValueForOption("--buffer-size").getIntValue()) : 512;
+    const float threshold = args.containsOption("--threshold") ? args.getValueForOption("--threshold").getFloatValue() : 0.01f;
+    const float silenceLength = args.containsOption("--silence") ? args.getValueForOption("--silence").getFloatValue() : 2.0f;
+    const int forcedSplitInterval = args.containsOption("--forced-split") ? args.getValueForOption("--forced-split").getIntValue() : 0;
+    const int numStressSplits = args.containsOption("--stress-splits") ? jmax(0, args.getValueForOption("--stress-splits").getIntValue()) : 0;
+    const bool freeRunning = args.containsOption("--free-running") || numStressSplits > 0;
+    const double maxCallbackFraction = args.containsOption("--max-callback") ? args.getValueForOption("--max-callback").getDoubleValue() : 1.0;
+
+    auto tuneLengths = StringArray::fromTokens(args.containsOption("--tune-length") ? args.getValueForOption("--tune-length") : "5,120", ",", {});
+    std::unique_ptr<SyntheticSession> session;
+    if (inputReader == nullptr)
+    {
+        session.reset(new SyntheticSession(sampleRate,
+                                           args.containsOption("--duration") ? args.getValueForOption("--duration").getDoubleValue() : 3600.0,
+                                           silenceLength,
+                                           tuneLengths[0].getDoubleValue(),
+                                           jmax(tuneLengths[0].getDoubleValue(), tuneLengths[1].getDoubleValue()),
+                                           args.containsOption("--seed") ? args.getValueForOption("--seed").getLargeIntValue() : 1));
+    }
+
+    const bool keepOutput = args.containsOption("--output");
+    const File folder = keepOutput ? args.getFileForOption("--output") : File::createTempFile("replay");
+    folder.createDirectory();
+
+    int64 inputPosition = 0;
+    VirtualAudioDevice device(numChannels, sampleRate, bufferSize, [&](AudioBuffer<float> &block) {
+        if (session != nullptr)
+        {
+            return session->fill(block);
+        }
+        if (inputPosition >= inputReader->lengthInSamples)
+        {
+            return false;
+        }
+        inputReader->read(&block, 0, block.getNumSamples(), inputPosition, true, true); // zeros after the end
+        inputPosition += block.getNumSamples();
+        return true;
+    });
+    device.setSpeed(args.containsOption("--speed") ? args.getValueForOption("--speed").getDoubleValue() : 0.0);
+
+    AudioThumbnailCache thumbnailCache(1);
+    AudioThumbnail thumbnail(512, formatManager, thumbnailCache);
+    const auto startTime = Time::getMillisecondCounterHiRes();
+    int numForcedSplits = 0;
+    CallbackProfiler::Snapshot callbackProfile;
+    int64 numDroppedSamples = 0;
+    double spillHighWaterMark = 0;
+    AudioRecorder::SplitLatency splitLatency;
+    int64 numLostEvents = 0;
+    {
+        AudioRecorder recorder(thumbnail);
+        // no treatment: the files are compared with the input as recorded
+        recorder.initialize(folder.getFullPathName(),
+                            args.getValueForOption("--format") == "flac" ? AudioRecorder::SupportedAudioFormat::flac
+                                                                          : AudioRecorder::SupportedAudioFormat::wav,
+                            threshold, silenceLength, false, false, false, 0);
+        recorder.setPreparesNextWriter(!args.containsOption("--no-prepared-writer"));
+        if (args.containsOption("--spill"))
+        {
+            recorder.setSpillBufferLength(args.getValueForOption("--spill").getFloatValue());
+        }
+
+        int64 nextForcedSplit = (int64)(forcedSplitInterval * sampleRate / 1000.0);
+        bool isRecording = false;
+        auto onTimer = [&] {
+            if (!isRecording)
+            {
+                // the first call comes before the first block: nothing is played before the first file exists
+                recorder.startRecording();
+                isRecording = true;
+            }
+            // whatever the speed, the control thread reacts to an event within 10 ms of audio
+            recorder.waitUntilEventsHandled();
+            if (forcedSplitInterval > 0 && device.getNumSamplesProcessed() >= nextForcedSplit)
+            {
+                recorder.shouldRestart = true;
+                ++numForcedSplits;
+                nextForcedSplit += (int64)(forcedSplitInterval * sampleRate / 1000.0);
+                recorder.handlePendingRestart();
+            }
+        };
+        if (!freeRunning)
+        {
+            device.setSimulatedTimer(10, onTimer);
+        }
+
+        device.open({}, {}, sampleRate, bufferSize);
+        device.start(&recorder);
+        if (freeRunning)
+        {
+            recorder.startRecording(); // as the application does
+        }
+
+        SplitStressThread stressThread(recorder, numStressSplits);
+        if (numStressSplits > 0)
+        {
+            stressThread.startThread();
+        }
+
+        while (device.isPlaying())
+        {
+            MessageManager::getInstance()->runDispatchLoopUntil(20);
+        }
+        stressThread.stopThread(-1);
+        numForcedSplits += stressThread.getNumForcedSplits();
+        device.close();
+        recorder.waitUntilEventsHandled();
+        callbackProfile = recorder.getCallbackProfile();
+        numDroppedSamples = recorder.getNumDroppedSamples();
+        spillHighWaterMark = recorder.getSpillHighWaterMark();
+        splitLatency = recorder.getSplitLatency();
+        numLostEvents = recorder.getNumLostEvents();
+    } // the recorder closes the last file
+    const auto elapsedSeconds = (Time::getMillisecondCounterHiRes() - startTime) / 1000.0;
+
+    auto recordedFiles = readRecordedFiles(folder, formatManager);
+    const auto &callbackStatistics = device.getCallbackStatistics();
+    const double audioSeconds = device.getNumSamplesProcessed() / sampleRate;
+
+    auto *report = new DynamicObject();
+    report->setProperty("input", session != nullptr ? String("synthetic") : inputFile.getFullPathName());
+    report->setProperty("sampleRate", sampleRate);
+    report->setProperty("bufferSize", bufferSize);
+    report->setProperty("numChannels", numChannels);
+    report->setProperty("audioSeconds", audioSeconds);
+    report->setProperty("elapsedSeconds", elapsedSeconds);
+    report->setProperty("speed", elapsedSeconds > 0 ? audioSeconds / elapsedSeconds : 0.0);
+    report->setProperty("numCallbacks", callbackStatistics.numCallbacks);
+    report->setProperty("meanCallbackSeconds", callbackStatistics.numCallbacks > 0 ? callbackStatistics.totalSeconds / callbackStatistics.numCallbacks : 0.0);
+    report->setProperty("maxCallbackSeconds", callbackStatistics.maxSeconds);
+    report->setProperty("callbackBudgetSeconds", bufferSize / sampleRate);
+    report->setProperty("numLateCallbacks", callbackStatistics.numLateCallbacks);
+    report->setProperty("maxCallbackFraction", maxCallbackFraction);
+    report->setProperty("numRealtimeHeapCalls", RealtimeAllocationChecker::getNumRealtimeHeapCalls());
+    report->setProperty("numForcedSplits", numForcedSplits);
+    report->setProperty("numSplits", splitLatency.numSplits);
+    report->setProperty("meanSplitLatencySeconds", splitLatency.meanSeconds);
+    report->setProperty("maxSplitLatencySeconds", splitLatency.maxSeconds);
+    report->setProperty("numLostEvents", numLostEvents);
+    report->setProperty("spillDroppedSamples", numDroppedSamples);
+    report->setProperty("spillHighWaterSeconds", spillHighWaterMark);
+    report->setProperty("callbackProfile", profileToVar(callbackProfile));
+
+    int numFilesWithSound = 0;
+    int64 numSoundSamples = 0;
+    Array<var> files;
+    for (auto &recordedFile : recordedFiles)
+    {
+        auto *fileObject = new DynamicObject();
+        fileObject->setProperty("name", recordedFile.file.getFileName());
+        fileObject->setProperty("numSamples", recordedFile.numSamples);
+        fileObject->setProperty("numSoundSamples", recordedFile.numSoundSamples);
+        files.add(var(fileObject));
+
+        numFilesWithSound += recordedFile.numSoundSamples > 0 ? 1 : 0;
+        numSoundSamples += recordedFile.numSoundSamples;
+    }
+    report->setProperty("files", files);
+    report->setProperty("numFilesWithSound", numFilesWithSound);
+
+    // the callback never takes a lock nor waits for another thread: one that runs past the bound waited;
+    // nor does it allocate or free
+    const double blockSeconds = bufferSize / sampleRate;
+    bool passed = callbackStatistics.numCallbacks > 0
+                  && callbackStatistics.maxSeconds <= maxCallbackFraction * blockSeconds
+                  && RealtimeAllocationChecker::getNumRealtimeHeapCalls() == 0;
+    if (session != nullptr)
+    {
+        // every sound sample of the input must be in exactly one file, and each tune in its own file
+        int64 expectedSoundSamples = 0;
+        for (auto &tune : session->getTunes())
+        {
+            expectedSoundSamples += tune.numSamples;
+        }
+        const int expectedFiles = session->getTunes().size() + numForcedSplits;
+        report->setProperty("numTunes", session->getTunes().size());
+        report->setProperty("expectedSoundSamples", expectedSoundSamples);
+        report->setProperty("droppedSoundSamples", expectedSoundSamples - numSoundSamples);
+        const bool forcesSplits = forcedSplitInterval > 0 || numStressSplits > 0;
+        report->setProperty("splitErrors", forcesSplits ? 0 : numFilesWithSound - session->getTunes().size());
+
+        // the stress splits don't wait for a silence, the writer is replaced while the tune plays
+        passed = passed && (numStressSplits > 0 || numSoundSamples == expectedSoundSamples)
+                 && (forcesSplits ? numFilesWithSound <= expectedFiles : numFilesWithSound == session->getTunes().size());
+    }
+    report->setProperty("passed", passed);
+
+    const var reportVar(report);
+    std::cout << JSON::toString(reportVar) << std::endl;
+    if (args.containsOption("--report"))
+    {
+        args.getFileForOption("--report").replaceWithText(JSON::toString(reportVar));
+    }
+
+    if (!keepOutput)
+    {
+        folder.deleteRecursively();
+    }
+    return passed ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "AudioFileProcessor.h"
+#include "ParallelFlacWriter.h"
+#include "WavFileLayout.h"
+
+// An append-only journal of the files of a recording folder: created, recording, sample count
+// checkpoints, closed, each treatment done. After a crash, the next session reads it instead of the
+// folder: it knows which tunes were being recorded or treated, finishes only those, and removes the
+// files and the temp copies they left behind. The journal then starts over.
+//
+// One line per record, "record<tab>file name<tab>value"; a last line without its end of line was cut by
+// the crash and is ignored. Like the journal of WavInPlaceGain, it is written through the page cache
+// and covers a crash of the application, not of the system.
+class SessionJournal : public ReferenceCountedObject
+{
+public:
+    using Ptr = ReferenceCountedObjectPtr<SessionJournal>;
+
+    // what the former session left unfinished
+    struct Recovery
+    {
+        Array<File> unusedFiles;            // created in advance, never recorded into
+        Array<File> interruptedRecordings;  // never closed
+        Array<File> interruptedTreatments;  // closed, not treated
+    };
+
+    // reads what the former session left in the folder, then starts the journal over; the
+    // unfinished treatments are recorded again, as closed, so that a second crash still finds them
+    SessionJournal(const File &folder, Recovery &recovery)
+        : folder(folder)
+    {
+        folder.createDirectory(); // if not exists
+        const File file(getJournalFile(folder));
+        read(file, recovery);
+
+        file.replaceWithText({});
+        output.reset(new FileOutputStream(file));
+        for (auto &tune : recovery.interruptedRecordings)
+        {
+            if (canBeTreated(tune))
+                fileClosed(tune, -1);
+        }
+        for (auto &tune : recovery.interruptedTreatments)
+        {
+            fileClosed(tune, -1);
+        }
+    }
+
+    const File &getFolder() const noexcept
+    {
+        return folder;
+    }
+
+    static File getJournalFile(const File &folder)
+    {
+        return folder.getChildFile(".CollectionRecorder journal");
+    }
+
+    // the writer of the file exists, nothing has been recorded into it yet
+    void filePrepared(const File &file)
+    {
+        append("prepared", file, {});
+    }
+
+    // the audio callback may write into the file from now on
+    void fileOpened(const File &file)
+    {
+        append("opened", file, {});
+    }
+
+    void checkpoint(const File &file, int64 numSamples)
+    {
+        append("checkpoint", file, String(numSamples));
+    }
+
+    // -1 when the number of samples isn't known
+    void fileClosed(const File &file, int64 numSamples)
+    {
+        append("closed", file, String(numSamples));
+    }
+
+    void stageDone(const File &file, const String &stage)
+    {
+        append("stage", file, stage);
+    }
+
+    void fileTreated(const File &file)
+    {
+        append("treated", file, {});
+    }
+
+    void fileRemoved(const File &file)
+    {
+        append("removed", file, {});
+    }
+
+    // Finishes the work of a Recovery, on a background thread: deletes the unused files, resolves the
+    // temp copies of the interrupted treatments, makes the interrupted recordings readable (the sizes of
+    // a WAV header, the STREAMINFO and the SEEKTABLE of a FLAC file), then hands the files to treat to
+    // the function.
+    static void finish(const Recovery &recovery, const std::function<void(const File &)> &treat)
+    {
+        for (auto &file : recovery.unusedFiles)
+        {
+            file.deleteFile();
+        }
+        for (auto &file : recovery.interruptedRecordings)
+        {
+            if (canBeTreated(file))
+            {
+                if (file.hasFileExtension("flac"))
+                    ParallelFlacWriter::repairInterruptedFile(file);
+                else
+                    repairWavHeader(file);
+                treat(file);
+            }
+            else if (file.existsAsFile())
+            {
+                Logger::writeToLog(file.getFileName() + " was being recorded when the application stopped, it is left untreated");
+            }
+        }
+        for (auto &file : recovery.interruptedTreatments)
+        {
+            AudioFileProcessor::recoverInterruptedCopies(file);
+            if (file.existsAsFile())
+            {
+                treat(file);
+            }
+        }
+    }
+
+private:
+    const File folder;
+    CriticalSection lock;
+    std::unique_ptr<FileOutputStream> output;
+
+    void append(const String &record, const File &file, const String &value)
+    {
+        const ScopedLock sl(lock);
+        if (output != nullptr && output->openedOk())
+        {
+            output->writeText(record + "\t" + file.getFileName() + "\t" + value + "\n", false, false, nullptr);
+            output->flush(); // into the page cache, so that it survives the application
+        }
+    }
+
+    void read(const File &file, Recovery &recovery) const
+    {
+        auto text = file.loadFileAsString();
+        if (!text.endsWithChar('\n'))
+        {
+            text = text.substring(0, text.lastIndexOfChar('\n') + 1); // the record being written when it crashed
+        }
+
+        // the last record of each file tells where it was left
+        StringArray names;
+        StringArray states;
+        for (auto &line : StringArray::fromLines(text))
+        {
+            const auto fields = StringArray::fromTokens(line, "\t", {});
+            if (fields.size() < 2 || fields[0] == "checkpoint")
+            {
+                continue;
+            }
+            int index = names.indexOf(fields[1]);
+            if (index < 0)
+            {
+                index = names.size();
+                names.add(fields[1]);
+                states.add({});
+            }
+            states.set(index, fields[0]);
+        }
+
+        for (int i = 0; i < names.size(); i++)
+        {
+            const File tune(folder.getChildFile(names[i]));
+            const auto &state = states[i];
+            if (state == "prepared")
+                recovery.unusedFiles.add(tune);
+            else if (state == "opened")
+                recovery.interruptedRecordings.add(tune);
+            else if (state == "closed" || state == "stage")
+                recovery.interruptedTreatments.add(tune);
+        }
+    }
+
+    static bool canBeTreated(const File &interruptedRecording)
+    {
+        return interruptedRecording.existsAsFile() && interruptedRecording.hasFileExtension("wav;flac");
+    }
+
+    // The WAV writer of JUCE only updates the sizes of its header when it is closed: an interrupted
+    // recording still says it has no samples. The data is the last chunk, its size is what follows it.
+    static void repairWavHeader(const File &file)
+    {
+        auto layout = WavFileLayout::read(file);
+        if (!layout.isSupportedPCM() || layout.isRF64 || layout.dataSize != 0)
+        {
+            return;
+        }
+
+        const int64 dataSize = (layout.fileSize - layout.dataOffset) / layout.blockAlign * layout.blockAlign;
+        if (dataSize <= 0 || layout.dataOffset + dataSize - 8 > (int64)0xffffffff)
+        {
+            return;
+        }
+
+        FileOutputStream output(file);
+        if (output.openedOk())
+        {
+            output.setPosition(layout.dataHeaderOffset + 4);
+            output.writeInt((int)(uint32)dataSize);
+            if (layout.factOffset > 0)
+            {
+                output.setPosition(layout.factOffset);
+                output.writeInt((int)(uint32)(dataSize / layout.blockAlign));
+            }
+            output.setPosition(4);
+            output.writeInt((int)(uint32)(layout.dataOffset + dataSize - 8));
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SessionJournal)
+};
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <JuceHeader.h>
+#include "CircularBuffer.h"
+
+// Splits a stream at silences: the RMS level of the last window of samples is checked after each
+// block, the silence starts when it falls below the threshold and ends when it rises above it.
+// The window is also the pre-roll memory written at the start of a tune.
+// Used by the live recorder and by the offline splitter, so that both split at the same places.
+class SilenceDetector
+{
+public:
+    enum class Event
+    {
+        none,
+        silenceStarted,
+        soundStarted
+    };
+
+    // allocates the window, not real-time safe
+    void prepare(int numChannels, int windowSize)
+    {
+        memoryBuffer.reset(new CircularBuffer<float>(numChannels, windowSize));
+        silence = true;
+    }
+
+    void setThreshold(float newThreshold) noexcept
+    {
+        threshold = newThreshold;
+    }
+
+    Event process(const AudioBuffer<float> &block) noexcept
+    {
+        push(block);
+        return evaluate();
+    }
+
+    // process() in two steps, for the callers that time them
+    void push(const AudioBuffer<float> &block) noexcept
+    {
+        memoryBuffer->push(block);
+    }
+
+    Event evaluate() noexcept
+    {
+        if (memoryBuffer->isBufferFull())
+        {
+            const auto event = getEvent(silence, memoryBuffer->getRMSLevel(), threshold);
+            if (event != Event::none)
+            {
+                silence = event == Event::silenceStarted;
+            }
+            return event;
+        }
+        return Event::none;
+    }
+
+    // the transition rule, shared with the offline analysis that computes the levels by itself
+    static Event getEvent(bool isSilence, float rmsLevel, float threshold) noexcept
+    {
+        if (!isSilence && rmsLevel < threshold)
+        {
+            return Event::silenceStarted;
+        }
+        else if (isSilence && rmsLevel > threshold)
+        {
+            return Event::soundStarted;
+        }
+        return Event::none;
+    }
+
+    bool isSilence() const noexcept
+    {
+        return silence;
+    }
+
+    CircularBuffer<float> &getMemory() noexcept
+    {
+        return *memoryBuffer;
+    }
+
+private:
+    std::unique_ptr<CircularBuffer<float>> memoryBuffer;
+    std::atomic<float> threshold{0.01f};
+    std::atomic<bool> silence{true};
+};
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Finds where the sound starts and ends in a block: the first and the last sample whose magnitude over
+// all the channels reaches the threshold, as AudioBuffer::getMagnitude(i, 1) >= threshold would.
+// The samples are checked by chunks with FloatVectorOperations::findMinAndMax, which is vectorised:
+// a silent chunk costs a few SIMD instructions per sample and channel, only the chunk holding the
+// boundary is searched sample by sample.
+struct SilenceSearch
+{
+    static constexpr int chunkSize = 256;
+
+    // -1 when the whole block is below the threshold
+    static int findFirstSound(const float *const *channels, int numChannels, int numSamples, float threshold) noexcept
+    {
+        for (int start = 0; start < numSamples; start += chunkSize)
+        {
+            const int length = jmin(chunkSize, numSamples - start);
+            if (containsSound(channels, numChannels, start, length, threshold))
+            {
+                for (int i = start; i < start + length; i++)
+                {
+                    if (getMagnitude(channels, numChannels, i) >= threshold)
+                    {
+                        return i;
+                    }
+                }
+            }
+        }
+        return -1;
+    }
+
+    // -1 when the whole block is below the threshold
+    static int findLastSound(const float *const *channels, int numChannels, int numSamples, float threshold) noexcept
+    {
+        for (int end = numSamples; end > 0; end -= chunkSize)
+        {
+            const int start = jmax(0, end - chunkSize);
+            if (containsSound(channels, numChannels, start, end - start, threshold))
+            {
+                for (int i = end - 1; i >= start; i--)
+                {
+                    if (getMagnitude(channels, numChannels, i) >= threshold)
+                    {
+                        return i;
+                    }
+                }
+            }
+        }
+        return -1;
+    }
+
+private:
+    static bool containsSound(const float *const *channels, int numChannels, int start, int length, float threshold) noexcept
+    {
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            const auto range = FloatVectorOperations::findMinAndMax(channels[channel] + start, length);
+            if (range.getEnd() >= threshold || -range.getStart() >= threshold)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static float getMagnitude(const float *const *channels, int numChannels, int index) noexcept
+    {
+        float magnitude = 0;
+        for (int channel = 0; channel < numChannels; channel++)
+        {
+            magnitude = jmax(magnitude, std::abs(channels[channel][index]));
+        }
+        return magnitude;
+    }
+};
\ No newline at end of file
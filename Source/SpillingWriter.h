@@ -0,0 +1,219 @@
+#pragma once
+
+#include <atomic>
+#include <JuceHeader.h>
+#include "LoudnessMeter.h"
+
+// The sample buffers of the SpillingWriters, recycled from one file to the next so that a split
+// doesn't allocate (and touch) tens of megabytes. Any thread, but not the audio one.
+class SpillBufferPool
+{
+public:
+    std::unique_ptr<AudioBuffer<float>> acquire(int numChannels, int numSamples)
+    {
+        {
+            const ScopedLock sl(lock);
+            for (int i = 0; i < freeBuffers.size(); i++)
+            {
+                if (freeBuffers[i]->getNumChannels() == numChannels && freeBuffers[i]->getNumSamples() == numSamples)
+                {
+                    return std::unique_ptr<AudioBuffer<float>>(freeBuffers.removeAndReturn(i));
+                }
+            }
+            freeBuffers.clear(); // the settings changed, the old sizes won't be asked again
+        }
+        // never on the audio thread: the pages are committed here rather than on its first writes
+        std::unique_ptr<AudioBuffer<float>> buffer(new AudioBuffer<float>(numChannels, numSamples));
+        buffer->clear();
+        return buffer;
+    }
+
+    void release(std::unique_ptr<AudioBuffer<float>> buffer)
+    {
+        const ScopedLock sl(lock);
+        freeBuffers.add(buffer.release());
+    }
+
+    // allocates the buffers in advance: the file being recorded, the one prepared for the next tune, and
+    // the one being closed; a pool that runs short allocates on the writer factory thread
+    void preallocate(int numChannels, int numSamples, int numBuffers = 3)
+    {
+        OwnedArray<AudioBuffer<float>> buffers;
+        for (int i = 0; i < numBuffers; i++)
+        {
+            buffers.add(acquire(numChannels, numSamples).release());
+        }
+        for (int i = buffers.size(); --i >= 0;)
+        {
+            release(std::unique_ptr<AudioBuffer<float>>(buffers.removeAndReturn(i)));
+        }
+    }
+
+private:
+    CriticalSection lock;
+    OwnedArray<AudioBuffer<float>> freeBuffers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpillBufferPool)
+};
+
+// Replaces AudioFormatWriter::ThreadedWriter with a FIFO that can hold minutes of audio: when the
+// disk stalls (a USB drive spinning up, a NAS hiccup, an encoder falling behind) the samples pile
+// up in memory and are written once it's back. The audio thread only copies into the FIFO; when it
+// is full anyway, the block is dropped and counted instead of being silently lost.
+//
+// With measureLoudness, the samples also go through a LoudnessMeter on their way to the disk.
+class SpillingWriter : private TimeSliceClient
+{
+public:
+    SpillingWriter(AudioFormatWriter *writerToUse, TimeSliceThread &thread, SpillBufferPool &bufferPool, int bufferSize,
+                   bool measureLoudness = false)
+        : writer(writerToUse),
+          thread(thread),
+          bufferPool(bufferPool),
+          buffer(bufferPool.acquire((int)writerToUse->getNumChannels(), bufferSize)),
+          fifo(bufferSize),
+          sampleRate(writerToUse->getSampleRate())
+    {
+        readPointers.calloc((size_t)buffer->getNumChannels());
+        if (measureLoudness)
+        {
+            loudnessMeter.reset(new LoudnessMeter());
+            loudnessMeter->reset(sampleRate, buffer->getNumChannels());
+        }
+        thread.addTimeSliceClient(this);
+    }
+
+    ~SpillingWriter() override
+    {
+        close();
+        bufferPool.release(std::move(buffer));
+    }
+
+    // writes what's left in the FIFO, on the calling thread, then closes the file; once the audio thread stopped writing
+    void close()
+    {
+        if (writer != nullptr)
+        {
+            thread.removeTimeSliceClient(this);
+            while (writeToDisk() > 0)
+            {
+            }
+            writer.reset();
+        }
+    }
+
+    // the measure of all the samples written, complete after close(); nullptr without measureLoudness
+    const LoudnessMeter *getLoudnessMeter() const noexcept
+    {
+        return loudnessMeter.get();
+    }
+
+    // audio thread
+    bool write(const float *const *data, int numSamples) noexcept
+    {
+        if (numSamples <= 0)
+        {
+            return true;
+        }
+
+        int start1, size1, start2, size2;
+        fifo.prepareToWrite(numSamples, start1, size1, start2, size2);
+        if (size1 + size2 < numSamples)
+        {
+            numDroppedSamples.fetch_add(numSamples, std::memory_order_relaxed);
+            return false;
+        }
+
+        for (int i = 0; i < buffer->getNumChannels(); i++)
+        {
+            buffer->copyFrom(i, start1, data[i], size1);
+            buffer->copyFrom(i, start2, data[i] + size1, size2);
+        }
+        fifo.finishedWrite(numSamples);
+
+        const int used = fifo.getNumReady();
+        if (used > highWaterMark.load(std::memory_order_relaxed))
+        {
+            highWaterMark.store(used, std::memory_order_relaxed); // only the audio thread writes it
+        }
+        return true;
+    }
+
+    int getBufferSize() const noexcept
+    {
+        return fifo.getTotalSize() - 1;
+    }
+
+    // the most samples that have been waiting for the disk at once
+    int getHighWaterMark() const noexcept
+    {
+        return highWaterMark.load(std::memory_order_relaxed);
+    }
+
+    int64 getNumDroppedSamples() const noexcept
+    {
+        return numDroppedSamples.load(std::memory_order_relaxed);
+    }
+
+    // handed to the file writer so far
+    int64 getNumSamplesWritten() const noexcept
+    {
+        return numSamplesWritten.load(std::memory_order_relaxed);
+    }
+
+    double getSampleRate() const noexcept
+    {
+        return sampleRate;
+    }
+
+private:
+    static constexpr int maxSamplesPerWrite = 1 << 16;
+
+    std::unique_ptr<AudioFormatWriter> writer;
+    TimeSliceThread &thread;
+    SpillBufferPool &bufferPool;
+    std::unique_ptr<AudioBuffer<float>> buffer;
+    AbstractFifo fifo;
+    HeapBlock<const float *> readPointers;
+    const double sampleRate;
+    std::unique_ptr<LoudnessMeter> loudnessMeter;
+    std::atomic<int> highWaterMark{0};
+    std::atomic<int64> numDroppedSamples{0};
+    std::atomic<int64> numSamplesWritten{0};
+
+    int useTimeSlice() override
+    {
+        // straight back while there's a backlog, otherwise a short nap
+        return writeToDisk() > 0 ? 0 : 10;
+    }
+
+    int writeToDisk()
+    {
+        int start1, size1, start2, size2;
+        fifo.prepareToRead(jmin(fifo.getNumReady(), maxSamplesPerWrite), start1, size1, start2, size2);
+
+        writeRun(start1, size1);
+        writeRun(start2, size2);
+        fifo.finishedRead(size1 + size2);
+        numSamplesWritten.fetch_add(size1 + size2, std::memory_order_relaxed);
+        return size1 + size2;
+    }
+
+    void writeRun(int start, int numSamples)
+    {
+        if (numSamples > 0)
+        {
+            for (int i = 0; i < buffer->getNumChannels(); i++)
+            {
+                readPointers[i] = buffer->getReadPointer(i, start);
+            }
+            writer->writeFromFloatArrays(readPointers, buffer->getNumChannels(), numSamples);
+            if (loudnessMeter != nullptr)
+            {
+                loudnessMeter->addBlock(readPointers, numSamples);
+            }
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SpillingWriter)
+};
\ No newline at end of file
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// What the post-record treatment needs to know about a recorded tune. It is gathered by the
+// recorder while capturing, so that the treatment doesn't need an analysis pass over the file.
+struct TuneStatistics
+{
+    bool isValid = false;
+    double sampleRate = 0;
+    int64 lengthInSamples = 0;
+    float peak = 0;
+    // first and last samples whose magnitude across channels reaches the threshold, -1 if there are none
+    int64 firstSoundSample = -1;
+    int64 lastSoundSample = -1;
+    // measured by the thread writing the file (see LoudnessMeter), when the loudness normalization asks for it
+    bool hasLoudness = false;
+    float integratedLoudness = 0; // LUFS
+    float truePeak = 0;
+
+    bool hasSound() const noexcept
+    {
+        return firstSoundSample >= 0;
+    }
+};
+
+// Accumulates TuneStatistics over the blocks written to a file. Real-time safe.
+class TuneStatisticsAccumulator
+{
+public:
+    void reset(double sampleRate, float soundThreshold) noexcept
+    {
+        statistics = TuneStatistics();
+        statistics.isValid = true;
+        statistics.sampleRate = sampleRate;
+        threshold = soundThreshold;
+    }
+
+    void addBlock(const float *const *channels, int numChannels, int numSamples) noexcept
+    {
+        float blockPeak = 0;
+        for (int i = 0; i < numChannels; i++)
+        {
+            auto range = FloatVectorOperations::findMinAndMax(channels[i], numSamples);
+            blockPeak = jmax(blockPeak, -range.getStart(), range.getEnd());
+        }
+        statistics.peak = jmax(statistics.peak, blockPeak);
+
+        // only the blocks containing sound need to be looked at sample by sample
+        if (blockPeak >= threshold)
+        {
+            if (!statistics.hasSound())
+            {
+                int i = 0;
+                while (getMagnitude(channels, numChannels, i) < threshold)
+                {
+                    ++i;
+                }
+                statistics.firstSoundSample = statistics.lengthInSamples + i;
+            }
+
+            int i = numSamples - 1;
+            while (getMagnitude(channels, numChannels, i) < threshold)
+            {
+                --i;
+            }
+            statistics.lastSoundSample = statistics.lengthInSamples + i;
+        }
+
+        statistics.lengthInSamples += numSamples;
+    }
+
+    const TuneStatistics &getStatistics() const noexcept
+    {
+        return statistics;
+    }
+
+private:
+    TuneStatistics statistics;
+    float threshold = 0;
+
+    static float getMagnitude(const float *const *channels, int numChannels, int index) noexcept
+    {
+        float magnitude = 0;
+        for (int i = 0; i < numChannels; i++)
+        {
+            magnitude = jmax(magnitude, std::abs(channels[i][index]));
+        }
+        return magnitude;
+    }
+};
\ No newline at end of file
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <atomic>
+#include <JuceHeader.h>
+
+// An audio device without hardware: the input blocks come from a function (a file, a synthetic
+// signal...), the output is discarded, and the callbacks run on the device thread as fast as
+// possible or at a chosen multiple of real time. It measures the time spent in the callback.
+//
+// The work that follows the audio in the application (the control thread handling a split) can't
+// keep up with the audio when it runs hundreds of times faster. With setSimulatedTimer(), the device
+// stops every interval of audio time, runs the timer callback on the message thread and waits for
+// it: the callback can wait for that work, which then behaves as it would in real time.
+class VirtualAudioDevice
+    : public AudioIODevice,
+      private Thread
+{
+public:
+    // fills the whole block with the next input samples, returns false once there are no more
+    using InputSource = std::function<bool(AudioBuffer<float> &block)>;
+
+    struct CallbackStatistics
+    {
+        int64 numCallbacks = 0;
+        int64 numLateCallbacks = 0; // that took longer than the duration of their block
+        double totalSeconds = 0;
+        double maxSeconds = 0;
+    };
+
+    VirtualAudioDevice(int numInputChannels, double sampleRate, int bufferSize, InputSource source)
+        : AudioIODevice("Virtual input", "Virtual"),
+          Thread("Virtual audio device"),
+          numInputChannels(numInputChannels),
+          sampleRate(sampleRate),
+          bufferSize(bufferSize),
+          source(std::move(source))
+    {
+    }
+
+    ~VirtualAudioDevice() override
+    {
+        close();
+    }
+
+    // 0 runs as fast as possible
+    void setSpeed(double newSpeed)
+    {
+        speed = newSpeed;
+    }
+
+    void setSimulatedTimer(int intervalMilliseconds, std::function<void()> callback)
+    {
+        timerInterval = (int64)(intervalMilliseconds * sampleRate / 1000.0);
+        timerCallback = std::move(callback);
+    }
+
+    // valid once the device has stopped
+    const CallbackStatistics &getCallbackStatistics() const noexcept
+    {
+        return statistics;
+    }
+
+    int64 getNumSamplesProcessed() const noexcept
+    {
+        return position;
+    }
+
+    //==============================================================================
+    StringArray getOutputChannelNames() override { return {}; }
+    StringArray getInputChannelNames() override
+    {
+        StringArray names;
+        for (int i = 0; i < numInputChannels; i++)
+            names.add("Input " + String(i + 1));
+        return names;
+    }
+
+    Array<double> getAvailableSampleRates() override { return {sampleRate}; }
+    Array<int> getAvailableBufferSizes() override { return {bufferSize}; }
+    int getDefaultBufferSize() override { return bufferSize; }
+
+    String open(const BigInteger &, const BigInteger &, double, int) override
+    {
+        // the configuration is the one given to the constructor
+        inputBuffer.setSize(numInputChannels, bufferSize);
+        outputBuffer.setSize(2, bufferSize);
+        opened = true;
+        return {};
+    }
+
+    void close() override
+    {
+        stop();
+        opened = false;
+    }
+
+    bool isOpen() override { return opened; }
+
+    void start(AudioIODeviceCallback *newCallback) override
+    {
+        if (opened && newCallback != nullptr && callback == nullptr)
+        {
+            newCallback->audioDeviceAboutToStart(this);
+            callback = newCallback;
+            finished = false;
+            startThread(Thread::realtimeAudioPriority);
+        }
+    }
+
+    void stop() override
+    {
+        if (callback != nullptr)
+        {
+            stopThread(-1);
+            callback->audioDeviceStopped();
+            callback = nullptr;
+        }
+    }
+
+    // false once the whole input has been played
+    bool isPlaying() override { return callback != nullptr && !finished; }
+    String getLastError() override { return {}; }
+    int getCurrentBufferSizeSamples() override { return bufferSize; }
+    double getCurrentSampleRate() override { return sampleRate; }
+    int getCurrentBitDepth() override { return 24; }
+
+    BigInteger getActiveOutputChannels() const override
+    {
+        BigInteger channels;
+        channels.setRange(0, 2, true);
+        return channels;
+    }
+
+    BigInteger getActiveInputChannels() const override
+    {
+        BigInteger channels;
+        channels.setRange(0, numInputChannels, true);
+        return channels;
+    }
+
+    int getOutputLatencyInSamples() override { return 0; }
+    int getInputLatencyInSamples() override { return 0; }
+
+private:
+    void run() override
+    {
+        const double blockSeconds = bufferSize / sampleRate;
+        const double startTime = Time::getMillisecondCounterHiRes();
+        int64 nextTimerPosition = 0; // the timer runs once before the first block
+
+        while (!threadShouldExit())
+        {
+            if (timerCallback != nullptr && position >= nextTimerPosition)
+            {
+                runTimerCallback();
+                nextTimerPosition += timerInterval;
+            }
+
+            if (!source(inputBuffer))
+            {
+                break;
+            }
+
+            const auto callbackStart = Time::getMillisecondCounterHiRes();
+            callback->audioDeviceIOCallback(inputBuffer.getArrayOfReadPointers(), numInputChannels,
+                                            outputBuffer.getArrayOfWritePointers(), outputBuffer.getNumChannels(), bufferSize);
+            const auto seconds = (Time::getMillisecondCounterHiRes() - callbackStart) / 1000.0;
+
+            ++statistics.numCallbacks;
+            statistics.totalSeconds += seconds;
+            statistics.maxSeconds = jmax(statistics.maxSeconds, seconds);
+            if (seconds > blockSeconds)
+            {
+                ++statistics.numLateCallbacks;
+            }
+            position += bufferSize;
+
+            if (speed > 0)
+            {
+                const auto due = startTime + 1000.0 * position / sampleRate / speed;
+                const auto now = Time::getMillisecondCounterHiRes();
+                if (due > now)
+                {
+                    Thread::sleep((int)(due - now));
+                }
+            }
+        }
+        finished = true;
+    }
+
+    void runTimerCallback()
+    {
+        // shared with the message, which can still run after we stopped waiting for it
+        auto done = std::make_shared<WaitableEvent>();
+        MessageManager::callAsync([callbackToRun = timerCallback, done] {
+            callbackToRun();
+            done->signal();
+        });
+
+        // keeps an eye on the exit request, in case the message loop is gone
+        while (!done->wait(50) && !threadShouldExit())
+        {
+        }
+    }
+
+    const int numInputChannels;
+    const double sampleRate;
+    const int bufferSize;
+    InputSource source;
+
+    AudioBuffer<float> inputBuffer, outputBuffer;
+    AudioIODeviceCallback *callback = nullptr;
+    bool opened = false;
+    std::atomic<bool> finished{false};
+    double speed = 0;
+    int64 timerInterval = 0;
+    std::function<void()> timerCallback;
+    int64 position = 0;
+    CallbackStatistics statistics;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VirtualAudioDevice)
+};
\ No newline at end of file
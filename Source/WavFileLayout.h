@@ -0,0 +1,113 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Where things are in a RIFF/RF64 WAV file, for the treatments that work on the file in place
+// instead of decoding and re-encoding it.
+struct WavFileLayout
+{
+    bool isValid = false;
+    bool isRF64 = false;
+    bool isFloatingPoint = false;
+    bool hasChunksAfterData = false;
+    int numChannels = 0;
+    int bitsPerSample = 0;
+    int blockAlign = 0;
+    double sampleRate = 0;
+    int64 fileSize = 0;
+    int64 dataHeaderOffset = -1; // position of the "data" chunk id
+    int64 dataOffset = -1;       // position of the first sample
+    int64 dataSize = 0;          // in bytes
+    int64 ds64Offset = -1;       // position of the ds64 chunk content, RF64 only
+    int64 factOffset = -1;       // position of the fact chunk content, if any
+
+    int64 getNumFrames() const noexcept
+    {
+        return blockAlign > 0 ? dataSize / blockAlign : 0;
+    }
+
+    // 8 to 32 bit integer PCM and 32 bit float, which is what JUCE's WavAudioFormat writes
+    bool isSupportedPCM() const noexcept
+    {
+        return isValid && blockAlign == numChannels * (bitsPerSample / 8)
+            && (isFloatingPoint ? bitsPerSample == 32 : (bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32));
+    }
+
+    static int chunkName(const char *name) noexcept
+    {
+        return (int)ByteOrder::littleEndianInt(name);
+    }
+
+    static WavFileLayout read(const File &file)
+    {
+        WavFileLayout layout;
+        FileInputStream input(file);
+        if (input.failedToOpen())
+        {
+            return layout;
+        }
+
+        layout.fileSize = input.getTotalLength();
+        const int riffId = input.readInt();
+        input.readInt(); // RIFF size
+        if ((riffId != chunkName("RIFF") && riffId != chunkName("RF64")) || input.readInt() != chunkName("WAVE"))
+        {
+            return layout;
+        }
+        layout.isRF64 = riffId == chunkName("RF64");
+
+        int64 dataSize64 = -1;
+        bool hasFormat = false;
+        int64 position = 12;
+
+        while (position + 8 <= layout.fileSize && input.setPosition(position))
+        {
+            const int chunkId = input.readInt();
+            const int64 chunkSize = (int64)(uint32)input.readInt();
+
+            if (chunkId == chunkName("ds64"))
+            {
+                layout.ds64Offset = position + 8;
+                input.readInt64(); // RIFF size
+                dataSize64 = input.readInt64();
+            }
+            else if (chunkId == chunkName("fmt "))
+            {
+                int formatTag = (unsigned short)input.readShort();
+                layout.numChannels = (unsigned short)input.readShort();
+                layout.sampleRate = (double)(uint32)input.readInt();
+                input.readInt(); // bytes per second
+                layout.blockAlign = (unsigned short)input.readShort();
+                layout.bitsPerSample = (unsigned short)input.readShort();
+
+                if (formatTag == 0xfffe && chunkSize >= 40) // WAVE_FORMAT_EXTENSIBLE: the sub-format GUID starts with the real tag
+                {
+                    input.setPosition(position + 8 + 24);
+                    formatTag = (unsigned short)input.readShort();
+                }
+                layout.isFloatingPoint = formatTag == 3;
+                hasFormat = formatTag == 1 || formatTag == 3;
+            }
+            else if (chunkId == chunkName("fact"))
+            {
+                layout.factOffset = position + 8;
+            }
+            else if (chunkId == chunkName("data"))
+            {
+                layout.dataHeaderOffset = position;
+                layout.dataOffset = position + 8;
+                layout.dataSize = (layout.isRF64 && chunkSize == 0xffffffff && dataSize64 >= 0) ? dataSize64 : chunkSize;
+                // a file that wasn't closed properly may be shorter than its header says
+                layout.dataSize = jmin(layout.dataSize, layout.fileSize - layout.dataOffset);
+                position = layout.dataOffset + layout.dataSize + (layout.dataSize & 1);
+                layout.hasChunksAfterData = position + 8 <= layout.fileSize;
+                break;
+            }
+
+            position += 8 + chunkSize + (chunkSize & 1);
+        }
+
+        layout.isValid = hasFormat && layout.dataOffset > 0 && layout.blockAlign > 0;
+        return layout;
+    }
+};
\ No newline at end of file
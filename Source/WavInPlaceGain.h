@@ -0,0 +1,293 @@
+#pragma once
+
+#include <atomic>
+#include <JuceHeader.h>
+#include "WavFileLayout.h"
+
+// Applies a gain to the samples of a WAV file in place, through a memory mapping of the file,
+// instead of writing a processed copy of it. Samples of 16 bits or less get the TPDF dither of
+// DitherStage, so that a tune is treated the same whether it is a WAV or not.
+//
+// The data is processed chunk by chunk and a small journal file next to the WAV keeps the gain,
+// the chunk being processed and the original bytes of that chunk (two slots used alternately, so
+// that the slot the journal points to is never the one being overwritten). If the process dies,
+// recoverPendingFiles() puts the interrupted chunk back and finishes the job. The journal is
+// written through the page cache and isn't synced: it covers a crash of the application, not of
+// the system. While a file is being processed it is claimed, so that a recovery running at the same
+// time in its folder leaves the journal of a live gain alone.
+class WavInPlaceGain
+{
+public:
+    // returns false, without touching the file, if its format isn't handled in place
+    static bool apply(const File &file, float gain)
+    {
+        const ScopedClaim claim(file);
+        if (!claim.isClaimed())
+        {
+            return false; // a recovery is finishing a former gain of it
+        }
+
+        auto layout = WavFileLayout::read(file);
+        if (!layout.isSupportedPCM() || layout.dataSize == 0)
+        {
+            return false;
+        }
+
+        const int chunkSize = getChunkSize(layout);
+        MemoryBlock journalData((size_t)(journalHeaderSize + 2 * chunkSize), true);
+        auto *header = static_cast<JournalHeader *>(journalData.getData());
+        header->magic = journalMagic;
+        header->gain = gain;
+        header->chunkSize = chunkSize;
+        header->pendingChunk = 0;
+
+        MemoryMappedFile mappedFile(file, MemoryMappedFile::readWrite);
+        if (mappedFile.getData() == nullptr)
+        {
+            return false;
+        }
+
+        // the journal starts with the first chunk already saved
+        auto *data = static_cast<char *>(mappedFile.getData()) + layout.dataOffset;
+        memcpy(getSlot(journalData.getData(), 0), data, (size_t)jmin((int64)chunkSize, layout.dataSize));
+
+        const File journalFile(getJournalFile(file));
+        if (!journalFile.replaceWithData(journalData.getData(), journalData.getSize()))
+        {
+            return false;
+        }
+
+        MemoryMappedFile mappedJournal(journalFile, MemoryMappedFile::readWrite);
+        if (mappedJournal.getData() == nullptr)
+        {
+            journalFile.deleteFile();
+            return false;
+        }
+
+        process(layout, data, mappedJournal.getData(), 0);
+        return journalFile.deleteFile();
+    }
+
+    // finishes the gain applications interrupted by a crash in a folder; the ones running in this
+    // process have a journal too, they are skipped
+    static void recoverPendingFiles(const File &folder)
+    {
+        for (auto &journalFile : folder.findChildFiles(File::findFiles, false, "*" + String(journalExtension)))
+        {
+            const File file(journalFile.getFullPathName().dropLastCharacters(String(journalExtension).length()));
+            const ScopedClaim claim(file);
+            if (!claim.isClaimed())
+            {
+                continue;
+            }
+            auto layout = WavFileLayout::read(file);
+
+            std::unique_ptr<MemoryMappedFile> mappedJournal(new MemoryMappedFile(journalFile, MemoryMappedFile::readWrite));
+            auto *header = static_cast<const JournalHeader *>(mappedJournal->getData());
+
+            if (header != nullptr && layout.isSupportedPCM()
+                && mappedJournal->getSize() >= (size_t)journalHeaderSize
+                && header->magic == journalMagic
+                && header->chunkSize == getChunkSize(layout)
+                && mappedJournal->getSize() == (size_t)(journalHeaderSize + 2 * header->chunkSize))
+            {
+                MemoryMappedFile mappedFile(file, MemoryMappedFile::readWrite);
+                if (mappedFile.getData() == nullptr)
+                {
+                    continue; // keep the journal, we'll try again
+                }
+
+                auto *data = static_cast<char *>(mappedFile.getData()) + layout.dataOffset;
+                const int64 chunkStart = header->pendingChunk * (int64)header->chunkSize;
+                if (chunkStart < layout.dataSize)
+                {
+                    // put the chunk that was being processed back as it was, and start again from there
+                    memcpy(data + chunkStart, getSlot(mappedJournal->getData(), header->pendingChunk),
+                           (size_t)jmin((int64)header->chunkSize, layout.dataSize - chunkStart));
+                    process(layout, data, mappedJournal->getData(), header->pendingChunk);
+                }
+            }
+
+            // an incomplete journal means the file hadn't been modified yet
+            mappedJournal.reset();
+            journalFile.deleteFile();
+        }
+    }
+
+    static File getJournalFile(const File &file)
+    {
+        return File(file.getFullPathName() + journalExtension);
+    }
+
+private:
+    // the files processed in this process, by apply() or a recovery, for as long as it lasts
+    class ScopedClaim
+    {
+    public:
+        explicit ScopedClaim(const File &file)
+            : file(file)
+        {
+            auto &claims = getClaims();
+            const ScopedLock sl(claims.lock);
+            claimed = !claims.files.contains(file);
+            if (claimed)
+            {
+                claims.files.add(file);
+            }
+        }
+
+        ~ScopedClaim()
+        {
+            if (claimed)
+            {
+                auto &claims = getClaims();
+                const ScopedLock sl(claims.lock);
+                claims.files.removeFirstMatchingValue(file);
+            }
+        }
+
+        bool isClaimed() const noexcept
+        {
+            return claimed;
+        }
+
+    private:
+        struct Claims
+        {
+            CriticalSection lock;
+            Array<File> files;
+        };
+
+        static Claims &getClaims()
+        {
+            static Claims claims;
+            return claims;
+        }
+
+        const File file;
+        bool claimed = false;
+
+        JUCE_DECLARE_NON_COPYABLE(ScopedClaim)
+    };
+
+    struct JournalHeader
+    {
+        uint32 magic;
+        float gain;
+        int32 chunkSize;
+        int32 padding;
+        int64 pendingChunk; // all the chunks before it are done, its original content is in slot pendingChunk % 2
+    };
+
+    static constexpr uint32 journalMagic = 0x4a475243; // "CRGJ"
+    static constexpr int journalHeaderSize = 64;
+    static constexpr const char *journalExtension = ".gainjournal";
+
+    static int getChunkSize(const WavFileLayout &layout) noexcept
+    {
+        return (1 << 20) / layout.blockAlign * layout.blockAlign;
+    }
+
+    static char *getSlot(void *journal, int64 chunk) noexcept
+    {
+        return static_cast<char *>(journal) + journalHeaderSize + (chunk % 2) * static_cast<JournalHeader *>(journal)->chunkSize;
+    }
+
+    static void process(const WavFileLayout &layout, char *data, void *journal, int64 firstChunk)
+    {
+        auto *header = static_cast<JournalHeader *>(journal);
+        const int chunkSize = header->chunkSize;
+        HeapBlock<float> scratch((size_t)chunkSize / (size_t)(layout.bitsPerSample / 8));
+        Random random;
+
+        for (int64 chunk = firstChunk; chunk * chunkSize < layout.dataSize; ++chunk)
+        {
+            auto *chunkData = data + chunk * chunkSize;
+            const int numBytes = (int)jmin((int64)chunkSize, layout.dataSize - chunk * chunkSize);
+
+            if (chunk != firstChunk)
+            {
+                // save the chunk, then point the journal to it, and only then modify it
+                memcpy(getSlot(journal, chunk), chunkData, (size_t)numBytes);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                header->pendingChunk = chunk;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+
+            applyGain(chunkData, numBytes / (layout.bitsPerSample / 8), layout, header->gain, scratch, random);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    // The samples of all channels get the same gain, so a chunk is handled as one run of samples:
+    // converted to floats, scaled and clipped with the vectorised FloatVectorOperations, converted back.
+    static void applyGain(char *samples, int numSamples, const WavFileLayout &layout, float gain, float *scratch, Random &random) noexcept
+    {
+        switch (layout.bitsPerSample)
+        {
+        case 8: // unsigned
+            for (int i = 0; i < numSamples; i++)
+                scratch[i] = (float)((uint8)samples[i] - 128);
+            scaleAndClip(scratch, numSamples, gain, 127.0f, &random);
+            for (int i = 0; i < numSamples; i++)
+                samples[i] = (char)(uint8)(roundToInt(scratch[i]) + 128);
+            break;
+
+        case 16:
+            for (int i = 0; i < numSamples; i++)
+                scratch[i] = (float)(int16)ByteOrder::littleEndianShort(samples + 2 * i);
+            scaleAndClip(scratch, numSamples, gain, 32767.0f, &random);
+            for (int i = 0; i < numSamples; i++)
+            {
+                const auto value = ByteOrder::swapIfBigEndian((uint16)(int16)roundToInt(scratch[i]));
+                memcpy(samples + 2 * i, &value, 2);
+            }
+            break;
+
+        case 24:
+            for (int i = 0; i < numSamples; i++)
+                scratch[i] = (float)ByteOrder::littleEndian24Bit(samples + 3 * i);
+            scaleAndClip(scratch, numSamples, gain, 8388607.0f, nullptr);
+            for (int i = 0; i < numSamples; i++)
+                ByteOrder::littleEndian24BitToChars(roundToInt(scratch[i]), samples + 3 * i);
+            break;
+
+        case 32:
+            if (layout.isFloatingPoint)
+            {
+                for (int i = 0; i < numSamples; i++)
+                    scratch[i] = ByteOrder::swapIfBigEndian(readUnaligned<float>(samples + 4 * i));
+                FloatVectorOperations::multiply(scratch, gain, numSamples);
+                for (int i = 0; i < numSamples; i++)
+                    writeUnaligned<float>(samples + 4 * i, ByteOrder::swapIfBigEndian(scratch[i]));
+            }
+            else
+            {
+                // floats don't have the precision of 32 bit integers
+                for (int i = 0; i < numSamples; i++)
+                {
+                    const auto value = (double)(int32)ByteOrder::littleEndianInt(samples + 4 * i) * gain;
+                    const auto result = ByteOrder::swapIfBigEndian((uint32)(int32)jlimit(-2147483648.0, 2147483647.0, std::round(value)));
+                    memcpy(samples + 4 * i, &result, 4);
+                }
+            }
+            break;
+
+        default:
+            jassertfalse;
+            break;
+        }
+    }
+
+    // the samples are in LSBs, the dither adds the difference of two uniform values in [0, 1)
+    static void scaleAndClip(float *scratch, int numSamples, float gain, float maxValue, Random *dither) noexcept
+    {
+        FloatVectorOperations::multiply(scratch, gain, numSamples);
+        if (dither != nullptr)
+        {
+            for (int i = 0; i < numSamples; i++)
+                scratch[i] += dither->nextFloat() - dither->nextFloat();
+        }
+        FloatVectorOperations::clip(scratch, scratch, -maxValue - 1.0f, maxValue, numSamples);
+    }
+};
\ No newline at end of file
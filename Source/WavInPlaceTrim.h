@@ -0,0 +1,112 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "WavFileLayout.h"
+
+// Trims a WAV file by rewriting its header instead of copying the samples to keep:
+// - the frames dropped at the end are cut off by shrinking the data chunk and truncating the file,
+// - the frames dropped at the beginning are turned into a JUNK chunk that readers skip, and the
+//   data chunk header is written again just before the first frame kept.
+// Only the headers are written, whatever the size of the file.
+class WavInPlaceTrim
+{
+public:
+    struct Result
+    {
+        bool wasTrimmed = false;
+        int64 startFrame = 0; // the frames actually kept, the start can be a frame or two earlier than asked
+        int64 numFrames = 0;
+        int64 bytesWritten = 0;
+    };
+
+    static Result apply(const File &file, int64 startFrame, int64 numFrames)
+    {
+        Result result;
+        auto layout = WavFileLayout::read(file);
+        if (!layout.isValid || layout.hasChunksAfterData)
+        {
+            return result;
+        }
+
+        startFrame = jlimit((int64)0, layout.getNumFrames(), startFrame);
+        int64 endFrame = jlimit(startFrame, layout.getNumFrames(), startFrame + numFrames);
+
+        // the JUNK chunk needs room for its own header, and chunks have to start on even positions
+        int64 skippedBytes = startFrame * layout.blockAlign;
+        if ((skippedBytes & 1) != 0)
+        {
+            --startFrame;
+            skippedBytes -= layout.blockAlign;
+        }
+        if (skippedBytes < 8)
+        {
+            startFrame = 0;
+            skippedBytes = 0;
+        }
+
+        const int64 newDataHeaderOffset = layout.dataHeaderOffset + skippedBytes;
+        const int64 newDataSize = (endFrame - startFrame) * layout.blockAlign;
+        const int64 newFileSize = newDataHeaderOffset + 8 + newDataSize + (newDataSize & 1);
+
+        FileOutputStream output(file);
+        if (output.failedToOpen())
+        {
+            return result;
+        }
+
+        // the new data chunk header lands inside the frames being dropped, it's invisible until the JUNK chunk exists
+        if (skippedBytes > 0)
+        {
+            result.bytesWritten += writeIntAt(output, newDataHeaderOffset, WavFileLayout::chunkName("data"));
+        }
+        result.bytesWritten += writeIntAt(output, newDataHeaderOffset + 4, layout.isRF64 ? -1 : (int)(uint32)newDataSize);
+
+        if (layout.isRF64)
+        {
+            output.setPosition(layout.ds64Offset);
+            output.writeInt64(newFileSize - 8);
+            output.writeInt64(newDataSize);
+            output.writeInt64(endFrame - startFrame);
+            result.bytesWritten += 24;
+        }
+        if (layout.factOffset > 0)
+        {
+            result.bytesWritten += writeIntAt(output, layout.factOffset, (int)(uint32)(endFrame - startFrame));
+        }
+
+        if (skippedBytes > 0)
+        {
+            result.bytesWritten += writeIntAt(output, layout.dataHeaderOffset, WavFileLayout::chunkName("JUNK"));
+            result.bytesWritten += writeIntAt(output, layout.dataHeaderOffset + 4, (int)(skippedBytes - 8));
+        }
+
+        result.bytesWritten += writeIntAt(output, 4, layout.isRF64 ? -1 : (int)(uint32)(newFileSize - 8));
+
+        if ((newDataSize & 1) != 0)
+        {
+            output.setPosition(newFileSize - 1);
+            output.writeByte(0); // pad byte
+            result.bytesWritten += 1;
+        }
+
+        output.setPosition(newFileSize);
+        if (output.truncate().failed())
+        {
+            jassertfalse;
+        }
+        output.flush();
+
+        result.wasTrimmed = !output.getStatus().failed();
+        result.startFrame = startFrame;
+        result.numFrames = endFrame - startFrame;
+        return result;
+    }
+
+private:
+    static int64 writeIntAt(FileOutputStream &output, int64 position, int value)
+    {
+        output.setPosition(position);
+        output.writeInt(value);
+        return 4;
+    }
+};
\ No newline at end of file
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SessionJournal.h"
+#include "SpillingWriter.h"
+
+// Opens the file and the writer of the next tune in advance, on its own thread, so that a split
+// never waits for the file system (directory creation, file creation, format header...).
+// All the file creations go through it, one at a time, so that two of them never pick the same name.
+class WriterFactory : private Thread
+{
+public:
+    struct PreparedWriter
+    {
+        File file;
+        std::unique_ptr<SpillingWriter> writer;
+        SessionJournal::Ptr journal; // of the folder, when there's one
+    };
+
+    using CreateFunction = std::function<PreparedWriter()>;
+
+    WriterFactory()
+        : Thread("Writer factory")
+    {
+    }
+
+    ~WriterFactory() override
+    {
+        stopThread(-1);
+        discard(prepared);
+    }
+
+    // the function runs on the factory thread, a request replaces one that hasn't started yet
+    void request(CreateFunction create)
+    {
+        {
+            const ScopedLock sl(lock);
+            pendingRequest = std::move(create);
+            busy = true;
+        }
+        if (!isThreadRunning())
+        {
+            startThread();
+        }
+        notify();
+    }
+
+    // the writer prepared, if it's ready or, when asked, once it is; an empty one otherwise
+    PreparedWriter take(bool waitIfBusy)
+    {
+        while (waitIfBusy && isBusy())
+        {
+            ready.wait(20);
+        }
+
+        const ScopedLock sl(lock);
+        return std::move(prepared);
+    }
+
+    bool isBusy() const
+    {
+        const ScopedLock sl(lock);
+        return busy;
+    }
+
+    // closes the writer and deletes its file, that never got a sample
+    static void discard(PreparedWriter &preparedWriter)
+    {
+        if (preparedWriter.writer != nullptr)
+        {
+            preparedWriter.writer.reset();
+            preparedWriter.file.deleteFile();
+            if (preparedWriter.journal != nullptr)
+            {
+                preparedWriter.journal->fileRemoved(preparedWriter.file);
+            }
+        }
+    }
+
+private:
+    CriticalSection lock;
+    CreateFunction pendingRequest;
+    PreparedWriter prepared;
+    bool busy = false;
+    WaitableEvent ready;
+
+    void run() override
+    {
+        while (!threadShouldExit())
+        {
+            CreateFunction create;
+            {
+                const ScopedLock sl(lock);
+                std::swap(create, pendingRequest);
+            }
+
+            if (create == nullptr)
+            {
+                wait(-1);
+                continue;
+            }
+
+            auto result = create();
+            {
+                const ScopedLock sl(lock);
+                discard(prepared); // not taken, replaced by the newer one
+                prepared = std::move(result);
+                busy = pendingRequest != nullptr;
+            }
+            ready.signal();
+        }
+    }
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WriterFactory)
+};
\ No newline at end of file